@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "pg_wrapper.h"
+
+namespace pg_wrapper::bench {
+
+// Connection string for the disposable benchmark database, taken from
+// PGWRAPPER_BENCH_DSN
+inline std::string connection_string() {
+    const char* dsn = std::getenv("PGWRAPPER_BENCH_DSN");
+    return dsn ? dsn : "dbname=postgres";
+}
+
+// Shared connection, opened on first use
+inline Database& database() {
+    static Database db(connection_string());
+    return db;
+}
+
+// n rows of (int, text, float8)
+inline std::string generate_rows_sql(long n) {
+    return "SELECT g, 'row-' || g, g * 0.5 FROM generate_series(1, " +
+           std::to_string(n) + ") AS g";
+}
+
+}  // namespace pg_wrapper::bench
@@ -0,0 +1,84 @@
+#include <benchmark/benchmark.h>
+
+#include <tuple>
+
+#include "bench_common.h"
+
+namespace pg_wrapper::bench {
+namespace {
+
+// Per-field lookup cost: by position, by name and by a pre-resolved column
+void BM_GetByIndex(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(state.range(0)));
+    for (auto _ : state) {
+        long sum = 0;
+        for (const auto& row : result) {
+            sum += row.get<int>(0);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * result.size());
+}
+BENCHMARK(BM_GetByIndex)->Arg(100000);
+
+void BM_GetByName(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(state.range(0)));
+    const std::string name = "g";
+    for (auto _ : state) {
+        long sum = 0;
+        for (const auto& row : result) {
+            sum += row.get<int>(name);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * result.size());
+}
+BENCHMARK(BM_GetByName)->Arg(100000);
+
+void BM_GetByColumnRef(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(state.range(0)));
+    const ColumnRef col = result.column("g");
+    for (auto _ : state) {
+        long sum = 0;
+        for (const auto& row : result) {
+            sum += row.get<int>(col);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * result.size());
+}
+BENCHMARK(BM_GetByColumnRef)->Arg(100000);
+
+struct Item {
+    int id;
+    std::string name;
+    double score;
+};
+
+// Whole-result conversion through a per-row callback
+void BM_ToVector(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(state.range(0)));
+    for (auto _ : state) {
+        auto items = result.to_vector<Item>([](const Row& row) {
+            return Item{row.get<int>(0), row.get<std::string>(1),
+                        row.get<double>(2)};
+        });
+        benchmark::DoNotOptimize(items.data());
+    }
+    state.SetItemsProcessed(state.iterations() * result.size());
+}
+BENCHMARK(BM_ToVector)->Arg(10000)->Arg(1000000);
+
+// Same conversion decoding tuples by position
+void BM_AsTuple(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(state.range(0)));
+    for (auto _ : state) {
+        auto items = result.as<std::tuple<int, std::string, double>>();
+        benchmark::DoNotOptimize(items.data());
+    }
+    state.SetItemsProcessed(state.iterations() * result.size());
+}
+BENCHMARK(BM_AsTuple)->Arg(10000)->Arg(1000000);
+
+}  // namespace
+}  // namespace pg_wrapper::bench
@@ -0,0 +1,70 @@
+#include <benchmark/benchmark.h>
+
+#include "bench_common.h"
+
+namespace pg_wrapper::bench {
+namespace {
+
+constexpr const char* kPointQuery = "SELECT $1::int + 1";
+
+// Simple-protocol round trip with the value inlined in the SQL
+void BM_Exec(benchmark::State& state) {
+    Database& db = database();
+    int i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            db.exec("SELECT " + std::to_string(++i) + "::int + 1"));
+    }
+}
+BENCHMARK(BM_Exec);
+
+// Parse, bind and execute each call
+void BM_ExecParams(benchmark::State& state) {
+    Database& db = database();
+    int i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db.exec_params(kPointQuery, ++i));
+    }
+}
+BENCHMARK(BM_ExecParams);
+
+// Bind and execute a statement parsed once
+void BM_ExecPrepared(benchmark::State& state) {
+    Database& db = database();
+    // Google Benchmark calls this function more than once, and the
+    // connection is shared
+    [[maybe_unused]] static const bool prepared = [&] {
+        db.prepare("bench_point", kPointQuery);
+        return true;
+    }();
+    int i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db.exec_prepared("bench_point", ++i));
+    }
+}
+BENCHMARK(BM_ExecPrepared);
+
+// Compile-time Statement: prepared once, no name lookup by string
+void BM_ExecStatement(benchmark::State& state) {
+    static constexpr Statement<std::tuple<int>(int)> kPoint(kPointQuery);
+    Database& db = database();
+    int i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db.exec_prepared(kPoint, ++i));
+    }
+}
+BENCHMARK(BM_ExecStatement);
+
+// exec_params() turned into exec_prepared() by the statement cache
+void BM_ExecParamsCached(benchmark::State& state) {
+    Database db(connection_string());
+    db.enable_statement_cache(16);
+    int i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db.exec_params(kPointQuery, ++i));
+    }
+}
+BENCHMARK(BM_ExecParamsCached);
+
+}  // namespace
+}  // namespace pg_wrapper::bench
@@ -0,0 +1,106 @@
+#include <benchmark/benchmark.h>
+
+#include <tuple>
+#include <vector>
+
+#include "bench_common.h"
+
+namespace pg_wrapper::bench {
+namespace {
+
+using InsertRow = std::tuple<int, std::string, double>;
+
+const std::vector<std::string> kColumns = {"id", "name", "score"};
+
+std::vector<InsertRow> make_rows(long n) {
+    std::vector<InsertRow> rows;
+    rows.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        rows.emplace_back(i, "row-" + std::to_string(i), i * 0.5);
+    }
+    return rows;
+}
+
+// Fresh unlogged table so runs do not depend on earlier state
+void reset_table(Database& db) {
+    db.exec("DROP TABLE IF EXISTS bench_insert");
+    db.exec(
+        "CREATE UNLOGGED TABLE bench_insert "
+        "(id int PRIMARY KEY, name text, score float8)");
+}
+
+void truncate_table(benchmark::State& state, Database& db) {
+    state.PauseTiming();
+    db.exec("TRUNCATE bench_insert");
+    state.ResumeTiming();
+}
+
+// One INSERT round trip per row
+void BM_Insert(benchmark::State& state) {
+    Database& db = database();
+    reset_table(db);
+    const auto rows = make_rows(state.range(0));
+    for (auto _ : state) {
+        truncate_table(state, db);
+        for (const auto& [id, name, score] : rows) {
+            db.insert("bench_insert", kColumns, id, name, score);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * rows.size());
+}
+BENCHMARK(BM_Insert)->Arg(1000)->Unit(benchmark::kMillisecond);
+
+// Multi-row INSERT in batches
+void BM_BatchInsert(benchmark::State& state) {
+    Database& db = database();
+    reset_table(db);
+    const auto rows = make_rows(state.range(0));
+    for (auto _ : state) {
+        truncate_table(state, db);
+        benchmark::DoNotOptimize(
+            db.batch_insert("bench_insert", kColumns, rows));
+    }
+    state.SetItemsProcessed(state.iterations() * rows.size());
+}
+BENCHMARK(BM_BatchInsert)
+    ->Arg(1000)
+    ->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+
+// Upsert over existing keys, so every row takes the conflict path
+void BM_BatchUpsert(benchmark::State& state) {
+    Database& db = database();
+    reset_table(db);
+    const auto rows = make_rows(state.range(0));
+    db.batch_insert("bench_insert", kColumns, rows);
+
+    BatchInsertOptions options;
+    options.conflictColumns = {"id"};
+    options.updateColumns = {"name", "score"};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            db.batch_insert("bench_insert", kColumns, rows, options));
+    }
+    state.SetItemsProcessed(state.iterations() * rows.size());
+}
+BENCHMARK(BM_BatchUpsert)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// COPY
+void BM_BulkInsert(benchmark::State& state) {
+    Database& db = database();
+    reset_table(db);
+    const auto rows = make_rows(state.range(0));
+    for (auto _ : state) {
+        truncate_table(state, db);
+        benchmark::DoNotOptimize(
+            db.bulk_insert("bench_insert", kColumns, rows));
+    }
+    state.SetItemsProcessed(state.iterations() * rows.size());
+}
+BENCHMARK(BM_BulkInsert)
+    ->Arg(1000)
+    ->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace pg_wrapper::bench
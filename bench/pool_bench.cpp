@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+
+#include "bench_common.h"
+
+namespace pg_wrapper::bench {
+namespace {
+
+constexpr size_t kPoolSize = 16;
+
+PoolOptions pool_options(PoolMode mode) {
+    PoolOptions options;
+    options.maxConnections = kPoolSize;
+    options.minIdle = kPoolSize;
+    options.mode = mode;
+    return options;
+}
+
+ConnectionPool& shared_pool(PoolMode mode) {
+    static ConnectionPool shared(connection_string(),
+                                 pool_options(PoolMode::Shared));
+    static ConnectionPool affinity(connection_string(),
+                                   pool_options(PoolMode::ThreadAffinity));
+    return mode == PoolMode::Shared ? shared : affinity;
+}
+
+// Acquire and return with no query in between: pure pool overhead, with
+// contention once threads outnumber connections
+void BM_PoolAcquireReturn(benchmark::State& state) {
+    ConnectionPool& pool = shared_pool(PoolMode(state.range(0)));
+    for (auto _ : state) {
+        auto conn = pool.acquire(std::chrono::seconds(10));
+        benchmark::DoNotOptimize(conn.get());
+        pool.return_connection(std::move(conn));
+    }
+    if (state.thread_index() == 0) {
+        const PoolStats stats = pool.stats();
+        state.counters["avg_wait_ns"] =
+            double(stats.average_wait_time().count());
+    }
+}
+BENCHMARK(BM_PoolAcquireReturn)
+    ->ArgName("affinity")
+    ->Arg(int(PoolMode::Shared))
+    ->Arg(int(PoolMode::ThreadAffinity))
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+
+// Acquire, run a trivial query, return
+void BM_PoolLeaseQuery(benchmark::State& state) {
+    ConnectionPool& pool = shared_pool(PoolMode::Shared);
+    for (auto _ : state) {
+        auto conn = pool.lease(std::chrono::seconds(10));
+        benchmark::DoNotOptimize(conn->exec("SELECT 1"));
+    }
+}
+BENCHMARK(BM_PoolLeaseQuery)->ThreadRange(1, 64)->UseRealTime();
+
+}  // namespace
+}  // namespace pg_wrapper::bench
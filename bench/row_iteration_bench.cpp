@@ -0,0 +1,71 @@
+#include <benchmark/benchmark.h>
+
+#include "bench_common.h"
+
+namespace pg_wrapper::bench {
+namespace {
+
+// Iterate with the RowRef the iterator yields: no per-row reference counts
+void BM_IterateRowRef(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(state.range(0)));
+    for (auto _ : state) {
+        size_t bytes = 0;
+        for (const auto& row : result) {
+            bytes += row.view(0).size() + row.view(1).size();
+        }
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetItemsProcessed(state.iterations() * result.size());
+}
+BENCHMARK(BM_IterateRowRef)->Arg(10000)->Arg(1000000);
+
+// Same loop materializing an owning Row per row, as iteration used to
+void BM_IterateRowCopy(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(state.range(0)));
+    for (auto _ : state) {
+        size_t bytes = 0;
+        for (auto itr = result.begin(); itr != result.end(); ++itr) {
+            const Row row = *itr;
+            bytes += row.view(0).size() + row.view(1).size();
+        }
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetItemsProcessed(state.iterations() * result.size());
+}
+BENCHMARK(BM_IterateRowCopy)->Arg(10000)->Arg(1000000);
+
+// Indexed access returns a RowRef as well
+void BM_IndexRowRef(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(state.range(0)));
+    for (auto _ : state) {
+        size_t bytes = 0;
+        for (size_t i = 0; i < result.size(); ++i) {
+            bytes += result[i].view(1).size();
+        }
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetItemsProcessed(state.iterations() * result.size());
+}
+BENCHMARK(BM_IndexRowRef)->Arg(10000)->Arg(1000000);
+
+void BM_ResultCopy(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(1000));
+    for (auto _ : state) {
+        Result copy = result;
+        benchmark::DoNotOptimize(copy);
+    }
+}
+BENCHMARK(BM_ResultCopy);
+
+void BM_ResultMove(benchmark::State& state) {
+    Result result = database().exec(generate_rows_sql(1000));
+    for (auto _ : state) {
+        Result moved = std::move(result);
+        benchmark::DoNotOptimize(moved);
+        result = std::move(moved);
+    }
+}
+BENCHMARK(BM_ResultMove);
+
+}  // namespace
+}  // namespace pg_wrapper::bench
@@ -1,118 +1,564 @@
 #include "pg_wrapper.h"
 
+#include <random>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
 namespace pg_wrapper {
 
+namespace {
+
+// connectionString with libpq's keepalive parameters added, in key/value
+// or URI form to match it
+std::string with_keepalive(const std::string& connectionString,
+                           const KeepaliveOptions& keepalive) {
+    if (!keepalive.enabled) {
+        return connectionString;
+    }
+    std::vector<std::pair<std::string, std::string>> params{
+        {"keepalives", "1"}};
+    if (keepalive.idle.count() > 0) {
+        params.emplace_back("keepalives_idle",
+                            std::to_string(keepalive.idle.count()));
+    }
+    if (keepalive.interval.count() > 0) {
+        params.emplace_back("keepalives_interval",
+                            std::to_string(keepalive.interval.count()));
+    }
+    if (keepalive.count > 0) {
+        params.emplace_back("keepalives_count",
+                            std::to_string(keepalive.count));
+    }
+
+    const bool uri = connectionString.rfind("postgresql://", 0) == 0 ||
+                     connectionString.rfind("postgres://", 0) == 0;
+    std::string result = connectionString;
+    for (const auto& [key, value] : params) {
+        if (uri) {
+            result += result.find('?') == std::string::npos ? '?' : '&';
+        } else if (!result.empty()) {
+            result += ' ';
+        }
+        result += key + '=' + value;
+    }
+    return result;
+}
+
+// Stable per-thread number used to pick a ThreadAffinity slot
+size_t thread_slot_hint() {
+    static std::atomic<size_t> nextHint{0};
+    thread_local const size_t hint =
+        nextHint.fetch_add(1, std::memory_order_relaxed);
+    return hint;
+}
+
+}  // namespace
+
 DatabaseError::DatabaseError(const std::string& msg)
     : std::runtime_error(msg) {}
 
 ConnectionError::ConnectionError(const std::string& msg)
     : DatabaseError("Connection error: " + msg) {}
 
-QueryError::QueryError(const std::string& msg)
-    : DatabaseError("Query error: " + msg) {}
+QueryError::QueryError(const std::string& msg, std::string sqlstate)
+    : DatabaseError("Query error: " + msg), _sqlstate(std::move(sqlstate)) {}
 
-Row::Row(const pqxx::row& row) : _row(row) {}
+TransactionRollbackError::TransactionRollbackError(const std::string& msg,
+                                                   std::string sqlstate)
+    : QueryError(msg, std::move(sqlstate)) {}
 
-// Get value by column index
-template <typename T>
-T Row::get(int col) const {
-    if (col >= _row.size()) {
-        throw std::out_of_range("Column index out of range");
+SerializationError::SerializationError(const std::string& msg,
+                                       std::string sqlstate)
+    : TransactionRollbackError(msg, std::move(sqlstate)) {}
+
+DeadlockError::DeadlockError(const std::string& msg, std::string sqlstate)
+    : TransactionRollbackError(msg, std::move(sqlstate)) {}
+
+ConstraintError::ConstraintError(const std::string& msg, std::string sqlstate)
+    : QueryError(msg, std::move(sqlstate)) {}
+
+PoolTimeoutError::PoolTimeoutError(const std::string& msg)
+    : ConnectionError(msg) {}
+
+ConnectionLostError::ConnectionLostError(const std::string& msg)
+    : ConnectionError(msg) {}
+
+namespace detail {
+
+void throw_query_error(const pqxx::sql_error& e) {
+    std::string state = e.sqlstate();
+    if (state == "40001") {
+        throw SerializationError(e.what(), std::move(state));
+    }
+    if (state == "40P01") {
+        throw DeadlockError(e.what(), std::move(state));
+    }
+    if (state.compare(0, 2, "40") == 0) {
+        throw TransactionRollbackError(e.what(), std::move(state));
+    }
+    if (state.compare(0, 2, "23") == 0) {
+        throw ConstraintError(e.what(), std::move(state));
     }
-    return _row[col].as<T>();
+    throw QueryError(e.what(), std::move(state));
 }
 
-// Get value by column name
-template <typename T>
-T Row::get(const std::string& colName) const {
-    return _row[colName].as<T>();
+std::chrono::microseconds jittered(std::chrono::microseconds ceiling) {
+    if (ceiling.count() <= 0) {
+        return std::chrono::microseconds(0);
+    }
+    thread_local std::mt19937_64 engine{std::random_device{}()};
+    std::uniform_int_distribution<std::chrono::microseconds::rep> dist(
+        0, ceiling.count());
+    return std::chrono::microseconds(dist(engine));
 }
 
-// Get optional value (returns nullopt if NULL)
-template <typename T>
-std::optional<T> Row::get_optional(int col) const {
-    if (col >= _row.size()) {
-        throw std::out_of_range("Column index out of range");
+void throw_database_error(const std::exception& e) {
+    // in_doubt_error derives from pqxx::failure, not broken_connection: a
+    // COMMIT with an unknown outcome must not look like a retryable loss
+    if (dynamic_cast<const pqxx::broken_connection*>(&e)) {
+        throw ConnectionLostError(e.what());
     }
-    return _row[col].is_null() ? std::nullopt
-                               : std::make_optional(_row[col].as<T>());
+    throw DatabaseError(e.what());
 }
 
-template <typename T>
-std::optional<T> Row::get_optional(const std::string& colName) const {
-    auto field = _row[colName];
-    return field.is_null() ? std::nullopt : std::make_optional(field.as<T>());
+}  // namespace detail
+
+namespace detail {
+
+namespace {
+
+// Read exactly width digits starting at pos
+bool read_digits(std::string_view text, size_t& pos, size_t width,
+                 int& value) {
+    if (pos + width > text.size()) {
+        return false;
+    }
+    auto [ptr, ec] = std::from_chars(text.data() + pos,
+                                     text.data() + pos + width, value);
+    if (ec != std::errc() || ptr != text.data() + pos + width) {
+        return false;
+    }
+    pos += width;
+    return true;
+}
+
+bool expect(std::string_view text, size_t& pos, char ch) {
+    if (pos < text.size() && text[pos] == ch) {
+        ++pos;
+        return true;
+    }
+    return false;
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date (H. Hinnant)
+int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const auto yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+int hex_value(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+}  // namespace
+
+// YYYY-MM-DD[ HH:MM:SS[.ffffff]][+HH[:MM[:SS]]]
+std::optional<std::chrono::system_clock::time_point> parse_timestamp(
+    std::string_view text) {
+    size_t pos = 0;
+    int year = 0, month = 0, day = 0;
+    if (!read_digits(text, pos, 4, year) || !expect(text, pos, '-') ||
+        !read_digits(text, pos, 2, month) || !expect(text, pos, '-') ||
+        !read_digits(text, pos, 2, day)) {
+        return std::nullopt;
+    }
+
+    int hour = 0, minute = 0, second = 0;
+    int64_t micros = 0;
+    if (expect(text, pos, ' ') || expect(text, pos, 'T')) {
+        if (!read_digits(text, pos, 2, hour) || !expect(text, pos, ':') ||
+            !read_digits(text, pos, 2, minute) || !expect(text, pos, ':') ||
+            !read_digits(text, pos, 2, second)) {
+            return std::nullopt;
+        }
+        if (expect(text, pos, '.')) {
+            int digits = 0;
+            for (; pos < text.size() && text[pos] >= '0' && text[pos] <= '9';
+                 ++pos) {
+                if (digits++ < 6) {
+                    micros = micros * 10 + (text[pos] - '0');
+                }
+            }
+            for (; digits < 6; ++digits) {
+                micros *= 10;
+            }
+        }
+    }
+
+    // UTC offset, as printed for timestamptz
+    int64_t offsetSeconds = 0;
+    if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+        const int sign = text[pos++] == '-' ? -1 : 1;
+        int offHour = 0, offMinute = 0, offSecond = 0;
+        if (!read_digits(text, pos, 2, offHour)) {
+            return std::nullopt;
+        }
+        if (expect(text, pos, ':') && !read_digits(text, pos, 2, offMinute)) {
+            return std::nullopt;
+        }
+        if (expect(text, pos, ':') && !read_digits(text, pos, 2, offSecond)) {
+            return std::nullopt;
+        }
+        offsetSeconds = sign * (offHour * 3600 + offMinute * 60 + offSecond);
+    }
+
+    // Anything left over (" BC", DateStyle variants) is not handled here
+    if (pos != text.size() || month < 1 || month > 12 || day < 1 ||
+        day > 31) {
+        return std::nullopt;
+    }
+
+    const int64_t seconds =
+        days_from_civil(year, month, day) * 86400 + hour * 3600 +
+        minute * 60 + second - offsetSeconds;
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::microseconds(seconds * 1000000 + micros)));
+}
+
+// Hex format output: a backslash, "x", then two hex digits per byte
+bool decode_bytea_hex(std::string_view text, std::vector<std::byte>& out) {
+    if (text.size() < 2 || text[0] != '\\' || text[1] != 'x' ||
+        text.size() % 2 != 0) {
+        return false;
+    }
+    out.resize((text.size() - 2) / 2);
+    for (size_t i = 2, j = 0; i < text.size(); i += 2, ++j) {
+        const int high = hex_value(text[i]);
+        const int low = hex_value(text[i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out[j] = static_cast<std::byte>((high << 4) | low);
+    }
+    return true;
+}
+
+ColumnIndex::ColumnIndex(const pqxx::result& result) : _result(result) {}
+
+// Index of the named column; throws like pqxx if there is none
+int ColumnIndex::find(const std::string& name) const {
+    std::call_once(_built, [this] {
+        const int columns = _result.columns();
+        _columns.reserve(columns);
+        for (int col = 0; col < columns; ++col) {
+            // First of any duplicate names wins, as with pqxx
+            _columns.emplace(_result.column_name(col), col);
+        }
+    });
+
+    // PQfnumber() folds unquoted names to lower case, so an exact match is
+    // only the same answer when there is nothing to fold or unquote
+    const bool folds = std::any_of(name.begin(), name.end(), [](char ch) {
+        return ch == '"' || (ch >= 'A' && ch <= 'Z');
+    });
+    if (!folds) {
+        auto itr = _columns.find(name);
+        if (itr != _columns.end()) {
+            return itr->second;
+        }
+    }
+    // Let pqxx handle case folding, quoted names and the error
+    return _result.column_number(name);
+}
+
+}  // namespace detail
+
+RowRef::RowRef(const pqxx::result* result, int row, const Result* owner)
+    : _result(result), _row(row), _owner(owner) {}
+
+size_t RowRef::row_number() const { return _row; }
+
+int RowRef::column_index(const std::string& colName) const {
+    return _owner ? _owner->column_index().find(colName)
+                  : _result->column_number(colName);
+}
+
+Row::Row(const pqxx::row& row) : _row(row) {}
+
+Row::Row(const pqxx::row& row,
+         std::shared_ptr<const detail::ColumnIndex> columns)
+    : _row(row), _columns(std::move(columns)) {}
+
+// Shares the index only if it exists already; building one just for this
+// row would undo the lazy construction
+Row::Row(const RowRef& ref)
+    : _row((*ref._result)[ref._row]),
+      _columns(ref._owner ? std::atomic_load(&ref._owner->_columns)
+                          : nullptr) {}
+
+// Index of the named column, through the shared map when available
+int Row::column_index(const std::string& colName) const {
+    return _columns ? _columns->find(colName) : _row.column_number(colName);
 }
 
+namespace detail {
+
 // Check if column is NULL
-bool Row::is_null(int col) const {
-    return col < _row.size() && _row[col].is_null();
+template <typename Derived>
+bool RowAccessors<Derived>::is_null(int col) const {
+    return col < self().field_count() && self().field(col).is_null();
+}
+
+template <typename Derived>
+bool RowAccessors<Derived>::is_null(const std::string& colName) const {
+    return self().field(self().column_index(colName)).is_null();
+}
+
+template <typename Derived>
+bool RowAccessors<Derived>::is_null(ColumnRef col) const {
+    return is_null(col.index);
+}
+
+// Text of a field without copying
+template <typename Derived>
+std::string_view RowAccessors<Derived>::view(int col) const {
+    if (col >= self().field_count()) {
+        throw std::out_of_range("Column index out of range");
+    }
+    return self().field(col).view();
+}
+
+template <typename Derived>
+std::string_view RowAccessors<Derived>::view(
+    const std::string& colName) const {
+    return self().field(self().column_index(colName)).view();
+}
+
+template <typename Derived>
+std::string_view RowAccessors<Derived>::view(ColumnRef col) const {
+    return view(col.index);
+}
+
+// bytea field without decoding or copying
+template <typename Derived>
+ByteView RowAccessors<Derived>::bytes(int col) const {
+    return is_null(col) ? ByteView() : ByteView(view(col));
+}
+
+template <typename Derived>
+ByteView RowAccessors<Derived>::bytes(const std::string& colName) const {
+    return bytes(self().column_index(colName));
 }
 
-bool Row::is_null(const std::string& colName) const {
-    return _row[colName].is_null();
+template <typename Derived>
+ByteView RowAccessors<Derived>::bytes(ColumnRef col) const {
+    return bytes(col.index);
 }
 
 // Get number of columns
-size_t Row::size() const { return _row.size(); }
+template <typename Derived>
+size_t RowAccessors<Derived>::size() const {
+    return self().field_count();
+}
 
 // // Column name access
 // std::string Row::column_name(size_t col) const {
 //     return _row.column_name(col);
 // }
 
-Result::iterator::iterator(pqxx::result::const_iterator itr) : _itr(itr) {}
+template class RowAccessors<Row>;
+template class RowAccessors<RowRef>;
 
-Row Result::iterator::operator*() const { return Row(*_itr); }
+}  // namespace detail
 
-bool Result::iterator::operator==(const Result::iterator& itr) const {
+ByteView::ByteView(std::string_view text) {
+    if (text.size() < 2 || text[0] != '\\' || text[1] != 'x' ||
+        text.size() % 2 != 0) {
+        throw pqxx::conversion_error("bytea field is not in hex format");
+    }
+    _hex = text.substr(2);
+    for (char ch : _hex) {
+        if (detail::hex_value(ch) < 0) {
+            throw pqxx::conversion_error("Invalid hex digit in bytea field");
+        }
+    }
+}
+
+size_t ByteView::size() const { return _hex.size() / 2; }
+bool ByteView::empty() const { return _hex.empty(); }
+
+std::byte ByteView::operator[](size_t i) const {
+    return static_cast<std::byte>((detail::hex_value(_hex[2 * i]) << 4) |
+                                  detail::hex_value(_hex[2 * i + 1]));
+}
+
+std::string_view ByteView::hex() const { return _hex; }
+
+void ByteView::copy_to(std::byte* out) const {
+    for (size_t i = 0; i < size(); ++i) {
+        out[i] = (*this)[i];
+    }
+}
+
+std::vector<std::byte> ByteView::to_vector() const {
+    std::vector<std::byte> bytes(size());
+    copy_to(bytes.data());
+    return bytes;
+}
+
+ColumnViews::iterator::iterator(pqxx::result::const_iterator itr, int col)
+    : _itr(itr), _col(col) {}
+
+std::string_view ColumnViews::iterator::operator*() const {
+    return (*_itr)[_col].view();
+}
+
+bool ColumnViews::iterator::is_null() const { return (*_itr)[_col].is_null(); }
+
+bool ColumnViews::iterator::operator==(const iterator& itr) const {
     return _itr == itr._itr;
 }
 
-bool Result::iterator::operator!=(const Result::iterator& itr) const {
+bool ColumnViews::iterator::operator!=(const iterator& itr) const {
     return _itr != itr._itr;
 }
 
-Result::iterator& Result::iterator::operator++() {
+ColumnViews::iterator& ColumnViews::iterator::operator++() {
     ++_itr;
     return *this;
 }
 
-Result::iterator Result::iterator::operator++(int) {
+ColumnViews::iterator ColumnViews::iterator::operator++(int) {
     auto itr = *this;
     ++_itr;
     return itr;
 }
 
-Result::Result(const pqxx::result& result) : _result(result) {}
+ColumnViews::ColumnViews(const pqxx::result& result, int col)
+    : _result(result), _col(col) {
+    if (col < 0 || col >= _result.columns()) {
+        throw std::out_of_range("Column index out of range");
+    }
+}
+
+ColumnViews::iterator ColumnViews::begin() const {
+    return iterator(_result.begin(), _col);
+}
+
+ColumnViews::iterator ColumnViews::end() const {
+    return iterator(_result.end(), _col);
+}
+
+size_t ColumnViews::size() const { return _result.size(); }
+
+Result::iterator::iterator(const pqxx::result* result, int row,
+                           const Result* owner)
+    : _result(result), _row(row), _owner(owner) {}
+
+RowRef Result::iterator::operator*() const {
+    return RowRef(_result, _row, _owner);
+}
+
+bool Result::iterator::operator==(const Result::iterator& itr) const {
+    return _row == itr._row && _result == itr._result;
+}
+
+bool Result::iterator::operator!=(const Result::iterator& itr) const {
+    return !(*this == itr);
+}
+
+Result::iterator& Result::iterator::operator++() {
+    ++_row;
+    return *this;
+}
+
+Result::iterator Result::iterator::operator++(int) {
+    auto itr = *this;
+    ++_row;
+    return itr;
+}
+
+Result::Result(pqxx::result result) : _result(std::move(result)) {}
+
+Result::Result(const Result& other)
+    : _result(other._result), _columns(std::atomic_load(&other._columns)) {}
+
+Result& Result::operator=(const Result& other) {
+    if (this != &other) {
+        _result = other._result;
+        std::atomic_store(&_columns, std::atomic_load(&other._columns));
+    }
+    return *this;
+}
+
+const detail::ColumnIndex& Result::column_index() const {
+    auto columns = std::atomic_load(&_columns);
+    if (!columns) {
+        std::shared_ptr<const detail::ColumnIndex> built =
+            std::make_shared<detail::ColumnIndex>(_result);
+        // On failure columns is set to the index another thread installed
+        if (std::atomic_compare_exchange_strong(&_columns, &columns, built)) {
+            columns = std::move(built);
+        }
+    }
+    return *columns;
+}
 
 Result::iterator Result::begin() const {
-    return Result::iterator(_result.begin());
+    return Result::iterator(&_result, 0, this);
+}
+
+Result::iterator Result::end() const {
+    return Result::iterator(&_result, _result.size(), this);
 }
-Result::iterator Result::end() const { return Result::iterator(_result.end()); }
 
 // Access rows
-Row Result::operator[](size_t rowNum) const {
+RowRef Result::operator[](size_t rowNum) const& {
     if (rowNum >= _result.size()) {
         throw std::out_of_range("Row index out of range");
     }
-    return Row(_result[rowNum]);
+    return RowRef(&_result, int(rowNum), this);
+}
+
+// The Result is about to go away, so the row must own its data
+Row Result::operator[](size_t rowNum) && {
+    return Row(std::as_const(*this)[rowNum]);
 }
 
-Row Result::at(size_t rowNum) const { return (*this)[rowNum]; }
+RowRef Result::at(size_t rowNum) const& { return (*this)[rowNum]; }
+
+Row Result::at(size_t rowNum) && { return Row(std::as_const(*this)[rowNum]); }
 
 // Get first row (throws if empty)
-Row Result::front() const {
+RowRef Result::front() const& {
     if (_result.empty()) {
         throw std::runtime_error("Result is empty");
     }
-    return Row(_result.front());
+    return RowRef(&_result, 0, this);
 }
 
+Row Result::front() && { return Row(std::as_const(*this).front()); }
+
 // Get first row as optional
-std::optional<Row> Result::front_optional() const {
+std::optional<RowRef> Result::front_optional() const& {
+    return _result.empty() ? std::nullopt
+                           : std::make_optional(RowRef(&_result, 0, this));
+}
+
+std::optional<Row> Result::front_optional() && {
     return _result.empty() ? std::nullopt
-                           : std::make_optional(Row(_result.front()));
+                           : std::make_optional(Row(
+                                 _result.front(), std::atomic_load(&_columns)));
 }
 
 // Result properties
@@ -126,160 +572,1445 @@ std::string Result::column_name(size_t col) const {
     return _result.column_name(col);
 }
 
-// Convert all rows to vector
-template <typename T>
-std::vector<T> Result::to_vector(std::function<T(const Row&)> converter) const {
-    std::vector<T> vec;
-    vec.reserve(size());
-    for (const auto& row : *this) {
-        vec.push_back(converter(row));
-    }
-    return vec;
+// Resolve a column name once, for fast by-name access in row loops
+ColumnRef Result::column(const std::string& name) const {
+    return ColumnRef{column_index().find(name)};
 }
 
-Transaction::Transaction(pqxx::connection& conn)
-    : _txn(std::make_unique<pqxx::work>(conn)), _committed(false) {}
-
-Transaction::~Transaction() {
-    if (!_committed) {
-        try {
-            _txn->abort();
-        } catch (...) {
-            // Ignore exceptions in destructor
-        }
-    }
+// Iterate one column as string_views into the result buffer
+ColumnViews Result::column_views(int col) const {
+    return ColumnViews(_result, col);
 }
 
-// Execute query
-Result Transaction::exec(const std::string& sql) {
-    try {
-        return Result(_txn->exec(sql));
-    } catch (const pqxx::sql_error& e) {
-        throw QueryError(e.what());
-    } catch (const std::exception& e) {
-        throw DatabaseError(e.what());
-    }
+ColumnViews Result::column_views(const std::string& name) const {
+    return ColumnViews(_result, column_index().find(name));
 }
 
-// Execute parameterized query
-template <typename... Args>
-Result Transaction::exec_params(const std::string& sql, Args&&... args) {
-    try {
-        return Result(_txn->exec_params(sql, std::forward<Args>(args)...));
-    } catch (const pqxx::sql_error& e) {
-        throw QueryError(e.what());
-    } catch (const std::exception& e) {
-        throw DatabaseError(e.what());
-    }
+ColumnViews Result::column_views(ColumnRef col) const {
+    return column_views(col.index);
 }
 
-// Execute prepared statement
-template <typename... Args>
-Result Transaction::exec_prepared(const std::string& name, Args&&... args) {
-    try {
-        return Result(_txn->exec_prepared(name, std::forward<Args>(args)...));
-    } catch (const pqxx::sql_error& e) {
-        throw QueryError(e.what());
-    } catch (const std::exception& e) {
-        throw DatabaseError(e.what());
+// Decode the whole result column by column
+ColumnarResult Result::to_columns() const {
+    ColumnarResult columnar;
+    columnar._rows = size();
+    columnar._columns = std::make_shared<std::vector<Column>>(columns());
+    for (size_t col = 0; col < columns(); ++col) {
+        (*columnar._columns)[col].decode(_result, int(col));
     }
+    return columnar;
 }
 
-// Commit transaction
-void Transaction::commit() {
-    if (_committed) {
-        throw std::runtime_error("Transaction already committed");
-    }
-    try {
-        _txn->commit();
-        _committed = true;
-    } catch (const std::exception& e) {
-        throw DatabaseError(e.what());
+namespace {
+
+// Built-in type OIDs from pg_type.dat
+ColumnType column_type_for(pqxx::oid type) {
+    switch (type) {
+        case 16:
+            return ColumnType::Boolean;
+        case 21:
+            return ColumnType::Int16;
+        case 23:
+            return ColumnType::Int32;
+        case 20:
+            return ColumnType::Int64;
+        case 700:
+            return ColumnType::Float32;
+        case 701:
+            return ColumnType::Float64;
+        case 1082:
+            return ColumnType::Date32;
+        case 1114:
+            return ColumnType::Timestamp;
+        case 1184:
+            return ColumnType::TimestampTz;
+        default:
+            return ColumnType::Utf8;
     }
 }
 
-// Abort transaction
-void Transaction::abort() {
-    if (!_committed) {
-        _txn->abort();
-        _committed = true;  // Mark as completed to avoid double-abort
+// Arrow format string for each column type
+const char* arrow_format(ColumnType type) {
+    switch (type) {
+        case ColumnType::Boolean:
+            return "b";
+        case ColumnType::Int16:
+            return "s";
+        case ColumnType::Int32:
+            return "i";
+        case ColumnType::Int64:
+            return "l";
+        case ColumnType::Float32:
+            return "f";
+        case ColumnType::Float64:
+            return "g";
+        case ColumnType::Date32:
+            return "tdD";
+        case ColumnType::Timestamp:
+            return "tsu:";
+        case ColumnType::TimestampTz:
+            return "tsu:UTC";
+        default:
+            return "u";
     }
 }
 
-// Quote and escape values
-std::string Transaction::quote(const std::string& value) {
-    return _txn->quote(value);
+int64_t epoch_micros(const pqxx::field& field) {
+    using Clock = std::chrono::system_clock;
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               detail::FieldDecoder<Clock::time_point>::decode(field)
+                   .time_since_epoch())
+        .count();
 }
 
-std::string Transaction::quote_name(const std::string& name) {
-    return _txn->quote_name(name);
+int32_t epoch_days(const pqxx::field& field) {
+    using Days = std::chrono::duration<int64_t, std::ratio<86400>>;
+    using Clock = std::chrono::system_clock;
+    return static_cast<int32_t>(
+        std::chrono::floor<Days>(
+            detail::FieldDecoder<Clock::time_point>::decode(field)
+                .time_since_epoch())
+            .count());
 }
 
-// Constructor with connection string
-Database::Database(const std::string& connectionString) {
-    try {
-        _conn = std::make_unique<pqxx::connection>(connectionString);
-    } catch (const std::exception& e) {
-        throw ConnectionError(e.what());
-    }
+inline void set_bit(std::vector<uint8_t>& bits, size_t i) {
+    bits[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
 }
 
-// Constructor with individual parameters
-Database::Database(const std::string& host, const std::string& port,
-                   const std::string& dbname, const std::string& user,
-                   const std::string& password) {
-    std::ostringstream oss;
-    oss << "host=" << host << " port=" << port << " dbname=" << dbname
-        << " user=" << user << " password=" << password;
+}  // namespace
 
-    try {
-        _conn = std::make_unique<pqxx::connection>(oss.str());
-    } catch (const std::exception& e) {
-        throw ConnectionError(e.what());
+void Column::decode(const pqxx::result& result, int col) {
+    _name = result.column_name(col);
+    _type = column_type_for(result.column_type(col));
+    _size = result.size();
+    _validity.assign((_size + 7) / 8, 0);
+
+    switch (_type) {
+        case ColumnType::Boolean:
+            _data.assign((_size + 7) / 8, std::byte{0});
+            for (size_t row = 0; row < _size; ++row) {
+                const pqxx::field field = result[int(row)][col];
+                if (field.is_null()) {
+                    ++_nullCount;
+                    continue;
+                }
+                set_bit(_validity, row);
+                if (detail::FieldDecoder<bool>::decode(field)) {
+                    _data[row / 8] |= std::byte(1u << (row % 8));
+                }
+            }
+            break;
+        case ColumnType::Int16:
+            decode_values<int16_t>(result, col,
+                                   detail::FieldDecoder<int16_t>::decode);
+            break;
+        case ColumnType::Int32:
+            decode_values<int32_t>(result, col,
+                                   detail::FieldDecoder<int32_t>::decode);
+            break;
+        case ColumnType::Int64:
+            decode_values<int64_t>(result, col,
+                                   detail::FieldDecoder<int64_t>::decode);
+            break;
+        case ColumnType::Float32:
+            decode_values<float>(result, col,
+                                 detail::FieldDecoder<float>::decode);
+            break;
+        case ColumnType::Float64:
+            decode_values<double>(result, col,
+                                  detail::FieldDecoder<double>::decode);
+            break;
+        case ColumnType::Date32:
+            decode_values<int32_t>(result, col, epoch_days);
+            break;
+        case ColumnType::Timestamp:
+        case ColumnType::TimestampTz:
+            decode_values<int64_t>(result, col, epoch_micros);
+            break;
+        case ColumnType::Utf8:
+            decode_text(result, col);
+            break;
     }
-}
 
-// Create transaction
-Transaction Database::begin_transaction() {
-    if (!is_open()) {
-        throw ConnectionError("Connection is not open");
+    // Arrow allows omitting the bitmap when nothing is NULL
+    if (_nullCount == 0) {
+        _validity.clear();
+        _validity.shrink_to_fit();
     }
-    return Transaction(*_conn);
 }
 
-// Execute query without transaction (auto-commit)
-Result Database::exec(const std::string& sql) {
-    auto txn = begin_transaction();
-    auto result = txn.exec(sql);
-    txn.commit();
-    return result;
+// Fixed-width values, written in place; NULL slots stay zero
+template <typename T, typename Decode>
+void Column::decode_values(const pqxx::result& result, int col,
+                           Decode decode) {
+    _data.assign(_size * sizeof(T), std::byte{0});
+    auto* out = reinterpret_cast<T*>(_data.data());
+    for (size_t row = 0; row < _size; ++row) {
+        const pqxx::field field = result[int(row)][col];
+        if (field.is_null()) {
+            ++_nullCount;
+            continue;
+        }
+        set_bit(_validity, row);
+        out[row] = decode(field);
+    }
 }
 
-// Execute parameterized query without transaction
-template <typename... Args>
-Result Database::exec_params(const std::string& sql, Args&&... args) {
-    auto txn = begin_transaction();
-    auto result = txn.exec_params(sql, std::forward<Args>(args)...);
-    txn.commit();
-    return result;
+void Column::decode_text(const pqxx::result& result, int col) {
+    _offsets.assign(_size + 1, 0);
+    for (size_t row = 0; row < _size; ++row) {
+        const pqxx::field field = result[int(row)][col];
+        if (field.is_null()) {
+            ++_nullCount;
+        } else {
+            set_bit(_validity, row);
+            const auto* begin =
+                reinterpret_cast<const std::byte*>(field.c_str());
+            _data.insert(_data.end(), begin, begin + field.size());
+            if (_data.size() > size_t(std::numeric_limits<int32_t>::max())) {
+                throw DatabaseError("Column " + _name +
+                                    " exceeds 2 GiB of text");
+            }
+        }
+        _offsets[row + 1] = static_cast<int32_t>(_data.size());
+    }
 }
 
-// Prepare statement
-void Database::prepare(const std::string& name, const std::string& sql) {
-    try {
-        _conn->prepare(name, sql);
-    } catch (const std::exception& e) {
-        throw DatabaseError(e.what());
+const std::string& Column::name() const { return _name; }
+ColumnType Column::type() const { return _type; }
+size_t Column::size() const { return _size; }
+size_t Column::null_count() const { return _nullCount; }
+
+bool Column::is_null(size_t row) const {
+    if (row >= _size) {
+        throw std::out_of_range("Row index out of range");
     }
+    return !_validity.empty() && !(_validity[row / 8] & (1u << (row % 8)));
 }
 
-// Execute prepared statement without transaction
-template <typename... Args>
-Result Database::exec_prepared(const std::string& name, Args&&... args) {
-    auto txn = begin_transaction();
-    auto result = txn.exec_prepared(name, std::forward<Args>(args)...);
-    txn.commit();
-    return result;
+const uint8_t* Column::validity() const {
+    return _validity.empty() ? nullptr : _validity.data();
+}
+
+template <typename T>
+const T* Column::values() const {
+    bool matches = false;
+    if constexpr (std::is_same_v<T, int16_t>) {
+        matches = _type == ColumnType::Int16;
+    } else if constexpr (std::is_same_v<T, int32_t>) {
+        matches = _type == ColumnType::Int32 || _type == ColumnType::Date32;
+    } else if constexpr (std::is_same_v<T, int64_t>) {
+        matches = _type == ColumnType::Int64 ||
+                  _type == ColumnType::Timestamp ||
+                  _type == ColumnType::TimestampTz;
+    } else if constexpr (std::is_same_v<T, float>) {
+        matches = _type == ColumnType::Float32;
+    } else if constexpr (std::is_same_v<T, double>) {
+        matches = _type == ColumnType::Float64;
+    }
+    if (!matches) {
+        throw std::invalid_argument("Column " + _name +
+                                    " does not hold the requested type");
+    }
+    return reinterpret_cast<const T*>(_data.data());
+}
+
+template const int16_t* Column::values<int16_t>() const;
+template const int32_t* Column::values<int32_t>() const;
+template const int64_t* Column::values<int64_t>() const;
+template const float* Column::values<float>() const;
+template const double* Column::values<double>() const;
+
+bool Column::boolean(size_t row) const {
+    if (_type != ColumnType::Boolean) {
+        throw std::invalid_argument("Column " + _name + " is not boolean");
+    }
+    if (row >= _size) {
+        throw std::out_of_range("Row index out of range");
+    }
+    return (_data[row / 8] & std::byte(1u << (row % 8))) != std::byte{0};
+}
+
+const int32_t* Column::offsets() const {
+    if (_type != ColumnType::Utf8) {
+        throw std::invalid_argument("Column " + _name + " is not text");
+    }
+    return _offsets.data();
+}
+
+std::string_view Column::text(size_t row) const {
+    if (row >= _size) {
+        throw std::out_of_range("Row index out of range");
+    }
+    const int32_t* offs = offsets();
+    return std::string_view(
+        reinterpret_cast<const char*>(_data.data()) + offs[row],
+        offs[row + 1] - offs[row]);
+}
+
+size_t ColumnarResult::rows() const { return _rows; }
+
+size_t ColumnarResult::columns() const {
+    return _columns ? _columns->size() : 0;
+}
+
+const Column& ColumnarResult::operator[](size_t col) const {
+    if (col >= columns()) {
+        throw std::out_of_range("Column index out of range");
+    }
+    return (*_columns)[col];
+}
+
+const Column& ColumnarResult::column(const std::string& name) const {
+    for (size_t col = 0; col < columns(); ++col) {
+        if ((*_columns)[col].name() == name) {
+            return (*_columns)[col];
+        }
+    }
+    throw std::out_of_range("Column not found: " + name);
+}
+
+namespace {
+
+// Producer-side state behind ArrowSchema/ArrowArray::private_data. Every
+// exported struct, children included, holds its own reference to the
+// column storage, so a consumer may move children out and release them
+// independently of the parent.
+struct ExportedSchema {
+    std::shared_ptr<std::vector<Column>> storage;
+    std::vector<ArrowSchema> children;
+    std::vector<ArrowSchema*> childPtrs;
+};
+
+struct ExportedArray {
+    std::shared_ptr<std::vector<Column>> storage;
+    std::array<const void*, 3> buffers{};
+    std::vector<ArrowArray> children;
+    std::vector<ArrowArray*> childPtrs;
+};
+
+void release_schema(ArrowSchema* schema) {
+    auto* exported = static_cast<ExportedSchema*>(schema->private_data);
+    for (auto& child : exported->children) {
+        if (child.release) {
+            child.release(&child);
+        }
+    }
+    delete exported;
+    schema->release = nullptr;
+}
+
+void release_array(ArrowArray* array) {
+    auto* exported = static_cast<ExportedArray*>(array->private_data);
+    for (auto& child : exported->children) {
+        if (child.release) {
+            child.release(&child);
+        }
+    }
+    delete exported;
+    array->release = nullptr;
+}
+
+}  // namespace
+
+// Export as an Arrow struct array with one child per column
+void ColumnarResult::export_arrow(ArrowArray* array,
+                                  ArrowSchema* schema) const {
+    const size_t n = columns();
+    auto parentSchema = std::make_unique<ExportedSchema>();
+    auto parentArray = std::make_unique<ExportedArray>();
+    parentSchema->storage = _columns;
+    parentArray->storage = _columns;
+    parentSchema->children.resize(n);
+    parentArray->children.resize(n);
+
+    // Allocate everything up front so nothing leaks if an allocation throws
+    std::vector<std::unique_ptr<ExportedSchema>> childSchemas;
+    std::vector<std::unique_ptr<ExportedArray>> childArrays;
+    for (size_t col = 0; col < n; ++col) {
+        childSchemas.push_back(std::make_unique<ExportedSchema>());
+        childSchemas.back()->storage = _columns;
+        childArrays.push_back(std::make_unique<ExportedArray>());
+        childArrays.back()->storage = _columns;
+        parentSchema->childPtrs.push_back(&parentSchema->children[col]);
+        parentArray->childPtrs.push_back(&parentArray->children[col]);
+    }
+
+    for (size_t col = 0; col < n; ++col) {
+        const Column& column = (*_columns)[col];
+
+        ArrowSchema& childSchema = parentSchema->children[col];
+        childSchema = ArrowSchema{};
+        childSchema.format = arrow_format(column._type);
+        childSchema.name = column._name.c_str();
+        childSchema.flags = ARROW_FLAG_NULLABLE;
+        childSchema.release = release_schema;
+        childSchema.private_data = childSchemas[col].release();
+
+        auto* exported = childArrays[col].release();
+        exported->buffers[0] = column.validity();
+        if (column._type == ColumnType::Utf8) {
+            exported->buffers[1] = column._offsets.data();
+            exported->buffers[2] = column._data.data();
+        } else {
+            exported->buffers[1] = column._data.data();
+        }
+
+        ArrowArray& childArray = parentArray->children[col];
+        childArray = ArrowArray{};
+        childArray.length = int64_t(column._size);
+        childArray.null_count = int64_t(column._nullCount);
+        childArray.n_buffers = column._type == ColumnType::Utf8 ? 3 : 2;
+        childArray.buffers = exported->buffers.data();
+        childArray.release = release_array;
+        childArray.private_data = exported;
+    }
+
+    *schema = ArrowSchema{};
+    schema->format = "+s";
+    schema->name = "";
+    schema->n_children = int64_t(n);
+    schema->children = parentSchema->childPtrs.data();
+    schema->release = release_schema;
+
+    *array = ArrowArray{};
+    array->length = int64_t(_rows);
+    array->n_buffers = 1;
+    array->n_children = int64_t(n);
+    array->buffers = parentArray->buffers.data();
+    array->children = parentArray->childPtrs.data();
+    array->release = release_array;
+
+    schema->private_data = parentSchema.release();
+    array->private_data = parentArray.release();
+}
+
+Transaction::Transaction(pqxx::connection& conn)
+    : _txn(std::make_unique<pqxx::work>(conn)), _committed(false) {}
+
+Transaction::Transaction(pqxx::connection& conn, Database* owner)
+    : Transaction(std::make_unique<pqxx::work>(conn), owner) {}
+
+Transaction::Transaction(std::unique_ptr<pqxx::transaction_base> txn,
+                         Database* owner)
+    : _txn(std::move(txn)), _committed(false), _owner(owner) {
+    _owner->_activeTxn = this;
+}
+
+// Savepoint within parent, sharing its Database but not registered there:
+// the Database only tracks the outermost transaction
+Transaction::Transaction(std::unique_ptr<pqxx::transaction_base> txn,
+                         Transaction& parent)
+    : _txn(std::move(txn)),
+      _committed(false),
+      _owner(parent._owner),
+      _parent(&parent) {
+    parent._savepoint = this;
+}
+
+Transaction::Transaction(Transaction&& other) noexcept
+    : _txn(std::move(other._txn)),
+      _committed(other._committed),
+      _owner(other._owner),
+      _ownArena(std::move(other._ownArena)) {
+    if (_owner && _owner->_activeTxn == &other) {
+        _owner->_activeTxn = this;
+    }
+    relink(other);
+    other._committed = true;  // Nothing left to abort
+    other._owner = nullptr;
+}
+
+Transaction& Transaction::operator=(Transaction&& other) noexcept {
+    if (this != &other) {
+        abort_savepoint();
+        detach();
+        if (!_committed && _txn) {
+            try {
+                _txn->abort();
+            } catch (...) {
+                // Ignore exceptions, as in the destructor
+            }
+        }
+        _txn = std::move(other._txn);
+        _committed = other._committed;
+        _owner = other._owner;
+        _ownArena = std::move(other._ownArena);
+        if (_owner && _owner->_activeTxn == &other) {
+            _owner->_activeTxn = this;
+        }
+        relink(other);
+        other._committed = true;
+        other._owner = nullptr;
+    }
+    return *this;
+}
+
+Transaction::~Transaction() {
+    abort_savepoint();
+    detach();
+    if (!_committed && _txn) {
+        try {
+            _txn->abort();
+        } catch (...) {
+            // Ignore exceptions in destructor
+        }
+    }
+}
+
+// Unregister from the owning Database and, for a savepoint, its parent
+void Transaction::detach() {
+    if (_owner && _owner->_activeTxn == this) {
+        _owner->_activeTxn = nullptr;
+    }
+    _owner = nullptr;
+    if (_parent) {
+        _parent->_savepoint = nullptr;
+        _parent = nullptr;
+    }
+}
+
+// Take over other's links to its parent and open savepoint
+void Transaction::relink(Transaction& other) noexcept {
+    _parent = std::exchange(other._parent, nullptr);
+    _savepoint = std::exchange(other._savepoint, nullptr);
+    if (_parent) {
+        _parent->_savepoint = this;
+    }
+    if (_savepoint) {
+        _savepoint->_parent = this;
+    }
+}
+
+// Roll back the open savepoint, which must end before its parent does
+void Transaction::abort_savepoint() noexcept {
+    if (_savepoint) {
+        try {
+            _savepoint->abort();
+        } catch (...) {
+            // The parent's own rollback discards its work anyway
+        }
+    }
+}
+
+Observer* Transaction::observer() const {
+    return _owner ? _owner->_observer.get() : nullptr;
+}
+
+detail::ParamArena& Transaction::param_arena() {
+    if (_owner) {
+        return _owner->_paramArena;
+    }
+    if (!_ownArena) {
+        _ownArena = std::make_unique<detail::ParamArena>();
+    }
+    return *_ownArena;
+}
+
+// Execute query
+Result Transaction::exec(const std::string& sql) {
+    const detail::QueryTimer timer(observer(), sql);
+    try {
+        Result result(_txn->exec(sql));
+        timer.succeeded(result);
+        return result;
+    } catch (const pqxx::sql_error& e) {
+        timer.failed(e);
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        timer.failed(e);
+        detail::throw_database_error(e);
+    }
+}
+
+// Commit transaction
+void Transaction::commit() {
+    if (_committed) {
+        throw std::runtime_error("Transaction already committed");
+    }
+    if (_savepoint) {
+        throw DatabaseError(
+            "Commit or abort the open savepoint before its transaction");
+    }
+    try {
+        _txn->commit();
+        _committed = true;
+        detach();
+    } catch (const pqxx::sql_error& e) {
+        // Serializable transactions can fail here rather than mid-statement
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+}
+
+// Abort transaction
+void Transaction::abort() {
+    abort_savepoint();
+    if (!_committed) {
+        _committed = true;  // Mark as completed to avoid double-abort
+        detach();
+        _txn->abort();
+    }
+}
+
+// Nested transaction rolled back on its own by abort()
+Transaction Transaction::savepoint(const std::string& name) {
+    auto* parent = dynamic_cast<pqxx::dbtransaction*>(_txn.get());
+    if (_committed || !parent) {
+        throw DatabaseError(
+            "Savepoints need an open transaction from begin_transaction()");
+    }
+    if (_savepoint) {
+        throw DatabaseError("This transaction already has an open savepoint");
+    }
+    try {
+        return Transaction(
+            std::make_unique<pqxx::subtransaction>(*parent, name), *this);
+    } catch (const pqxx::sql_error& e) {
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+}
+
+// Quote and escape values
+std::string Transaction::quote(const std::string& value) {
+    return _txn->quote(value);
+}
+
+std::string Transaction::quote_name(const std::string& name) {
+    return _txn->quote_name(name);
+}
+
+// Batch queries on this transaction
+Pipeline Transaction::pipeline() { return Pipeline(*this); }
+
+// COPY rows into table within this transaction
+Inserter Transaction::inserter(const std::string& table,
+                               const std::vector<std::string>& columns) {
+    return Inserter(*this, table, columns);
+}
+
+Pipeline::Pipeline(Transaction& txn)
+    : _txn(&txn), _pipe(std::make_unique<pqxx::pipeline>(*txn._txn)) {}
+
+Pipeline::Pipeline(std::unique_ptr<Transaction> txn)
+    : _ownedTxn(std::move(txn)),
+      _txn(_ownedTxn.get()),
+      _pipe(std::make_unique<pqxx::pipeline>(*_txn->_txn)) {}
+
+Pipeline::Pipeline(Pipeline&&) noexcept = default;
+Pipeline& Pipeline::operator=(Pipeline&& other) noexcept {
+    if (this != &other) {
+        // End the old pipeline while the transaction it runs on is alive
+        _pipe.reset();
+        forget_prepares();
+        _ownedTxn = std::move(other._ownedTxn);
+        _txn = other._txn;
+        _pipe = std::move(other._pipe);
+        _queued = std::move(other._queued);
+        _outcomes = std::move(other._outcomes);
+        _prepares = std::move(other._prepares);
+        other._prepares.clear();
+    }
+    return *this;
+}
+
+Pipeline::~Pipeline() { forget_prepares(); }
+
+// Queue a query
+QueryHandle Pipeline::exec(const std::string& sql) { return insert(sql); }
+
+// Result of a queued query, waiting for it if needed
+Result Pipeline::get(QueryHandle handle) {
+    auto itr = _outcomes.find(handle.id);
+    if (itr == _outcomes.end()) {
+        fetch(handle.id);
+        itr = _outcomes.find(handle.id);
+    }
+    if (itr->second.error) {
+        std::rethrow_exception(itr->second.error);
+    }
+    return *itr->second.result;
+}
+
+// Wait for every queued query
+void Pipeline::complete() {
+    for (auto id : _queued) {
+        if (_outcomes.count(id) == 0) {
+            fetch(id);
+        }
+    }
+    _queued.clear();
+}
+
+void Pipeline::retain(int maxQueries) { _pipe->retain(maxQueries); }
+
+// Send held-back queries and read available results without blocking
+void Pipeline::poll() {
+    try {
+        _pipe->resume();
+    } catch (const pqxx::sql_error& e) {
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+}
+
+// Whether get(handle) can return without waiting on the server
+bool Pipeline::ready(QueryHandle handle) const {
+    return _outcomes.count(handle.id) > 0 || _pipe->is_finished(handle.id);
+}
+
+QueryHandle Pipeline::insert(const std::string& sql) {
+    try {
+        const auto id = _pipe->insert(sql);
+        _queued.push_back(id);
+        return QueryHandle{id};
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+}
+
+void Pipeline::fetch(pqxx::pipeline::query_id id) {
+    Outcome outcome;
+    try {
+        try {
+            outcome.result.emplace(_pipe->retrieve(id));
+        } catch (const pqxx::sql_error& e) {
+            detail::throw_query_error(e);
+        } catch (const std::exception& e) {
+            detail::throw_database_error(e);
+        }
+    } catch (const DatabaseError&) {
+        // Kept for get() to rethrow
+        outcome.error = std::current_exception();
+    }
+
+    auto prepare = _prepares.find(id);
+    if (prepare != _prepares.end()) {
+        if (outcome.error) {
+            // Failed, or skipped after an earlier failure in its batch
+            prepare->second.db->_preparedNames.erase(prepare->second.name);
+        }
+        _prepares.erase(prepare);
+    }
+    _outcomes[id] = std::move(outcome);
+}
+
+// Whether those PREPAREs ran is unknown; unmarking them means the next
+// exec_prepared() prepares again, which at worst fails as a duplicate
+void Pipeline::forget_prepares() noexcept {
+    for (auto& [id, prepare] : _prepares) {
+        prepare.db->_preparedNames.erase(prepare.name);
+    }
+    _prepares.clear();
+}
+
+// get(), then forget the query, for long-lived pipelines
+Result Pipeline::take(QueryHandle handle) {
+    if (!_queued.empty() && _queued.front() == handle.id) {
+        _queued.pop_front();
+    }
+    auto itr = _outcomes.find(handle.id);
+    if (itr == _outcomes.end()) {
+        fetch(handle.id);
+        itr = _outcomes.find(handle.id);
+    }
+    Outcome outcome = std::move(itr->second);
+    _outcomes.erase(itr);
+    if (outcome.error) {
+        std::rethrow_exception(outcome.error);
+    }
+    return std::move(*outcome.result);
+}
+
+// Replace $1..$n outside quotes, comments and identifiers with literals
+std::string Pipeline::bind(const std::string& sql,
+                           const std::vector<std::string>& literals) {
+    std::string out;
+    out.reserve(sql.size() + 16 * literals.size());
+
+    const size_t n = sql.size();
+    size_t i = 0;
+    auto copyThrough = [&](size_t end) {
+        out.append(sql, i, end - i);
+        i = end;
+    };
+    auto isDigit = [&](size_t pos) {
+        return pos < n && std::isdigit(static_cast<unsigned char>(sql[pos]));
+    };
+    auto isTagChar = [&](size_t pos) {
+        return pos < n && (std::isalnum(static_cast<unsigned char>(sql[pos])) ||
+                           sql[pos] == '_');
+    };
+    // Identifiers may contain $ after their first character, like foo$1
+    auto isWordChar = [&](size_t pos) {
+        return isTagChar(pos) || (pos < n && sql[pos] == '$');
+    };
+
+    while (i < n) {
+        const char ch = sql[i];
+        if (ch == '$' && i > 0 && isWordChar(i - 1)) {
+            copyThrough(i + 1);
+        } else if (ch == '\'' || ch == '"') {
+            // Quoted literal or identifier; doubled quotes stay inside, and
+            // E'...' strings also escape with backslashes
+            const bool backslashes =
+                ch == '\'' && i > 0 &&
+                (sql[i - 1] == 'E' || sql[i - 1] == 'e') &&
+                (i < 2 || !isWordChar(i - 2));
+            size_t end = i + 1;
+            while (end < n) {
+                if (backslashes && sql[end] == '\\') {
+                    end += 2;
+                    continue;
+                }
+                if (sql[end] == ch) {
+                    if (end + 1 < n && sql[end + 1] == ch) {
+                        end += 2;
+                        continue;
+                    }
+                    break;
+                }
+                ++end;
+            }
+            copyThrough(std::min(end + 1, n));
+        } else if (ch == '-' && i + 1 < n && sql[i + 1] == '-') {
+            const size_t end = sql.find('\n', i);
+            copyThrough(end == std::string::npos ? n : end);
+        } else if (ch == '/' && i + 1 < n && sql[i + 1] == '*') {
+            const size_t end = sql.find("*/", i + 2);
+            copyThrough(end == std::string::npos ? n : end + 2);
+        } else if (ch == '$' && isDigit(i + 1)) {
+            size_t end = i + 1;
+            size_t param = 0;
+            while (isDigit(end)) {
+                param = param * 10 + (sql[end] - '0');
+                ++end;
+            }
+            if (param == 0 || param > literals.size()) {
+                throw std::invalid_argument("No value for parameter $" +
+                                            std::to_string(param));
+            }
+            out += literals[param - 1];
+            i = end;
+        } else if (ch == '$') {
+            // Dollar-quoted string: $tag$ ... $tag$
+            size_t tagEnd = i + 1;
+            while (isTagChar(tagEnd)) {
+                ++tagEnd;
+            }
+            if (tagEnd < n && sql[tagEnd] == '$') {
+                const std::string tag = sql.substr(i, tagEnd - i + 1);
+                const size_t end = sql.find(tag, tagEnd + 1);
+                copyThrough(end == std::string::npos ? n : end + tag.size());
+            } else {
+                copyThrough(i + 1);
+            }
+        } else {
+            copyThrough(i + 1);
+        }
+    }
+    return out;
+}
+
+StatementCache::StatementCache(size_t capacity) : _capacity(capacity) {
+    _index.reserve(capacity);
+}
+
+// Statement name for sql, or nullptr on a miss
+const std::string* StatementCache::find(const std::string& sql) {
+    auto itr = _index.find(sql);
+    if (itr == _index.end()) {
+        ++_misses;
+        return nullptr;
+    }
+    ++_hits;
+    _lru.splice(_lru.begin(), _lru, itr->second);
+    return &itr->second->name;
+}
+
+const std::string& StatementCache::insert(const std::string& sql,
+                                          std::string name,
+                                          std::optional<std::string>& evicted) {
+    _lru.push_front({sql, std::move(name)});
+    _index.emplace(_lru.front().sql, _lru.begin());
+
+    if (_lru.size() > _capacity) {
+        auto& oldest = _lru.back();
+        evicted = std::move(oldest.name);
+        _index.erase(oldest.sql);
+        _lru.pop_back();
+        ++_evictions;
+    }
+    return _lru.front().name;
+}
+
+// Forget every entry, returning the statement names that were cached
+std::vector<std::string> StatementCache::clear() {
+    std::vector<std::string> names;
+    names.reserve(_lru.size());
+    for (auto& entry : _lru) {
+        names.push_back(std::move(entry.name));
+    }
+    _index.clear();
+    _lru.clear();
+    return names;
+}
+
+StatementCacheStats StatementCache::stats() const {
+    StatementCacheStats stats;
+    stats.size = _lru.size();
+    stats.capacity = _capacity;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.evictions = _evictions;
+    return stats;
+}
+
+// Throws std::invalid_argument if name is registered with other SQL
+void PreparedRegistry::add(const std::string& name, const std::string& sql) {
+    std::lock_guard lockGuard(_mutex);
+    auto [itr, inserted] = _statements.emplace(name, sql);
+    if (!inserted && itr->second != sql) {
+        throw std::invalid_argument("Prepared statement '" + name +
+                                    "' is already registered");
+    }
+}
+
+// SQL registered under name, if any
+std::optional<std::string> PreparedRegistry::find(
+    const std::string& name) const {
+    std::lock_guard lockGuard(_mutex);
+    auto itr = _statements.find(name);
+    if (itr == _statements.end()) {
+        return std::nullopt;
+    }
+    return itr->second;
+}
+
+QueryCache::QueryCache(const QueryCacheOptions& options)
+    : _options(options),
+      _shardBytes(options.maxBytes / std::max<size_t>(options.shards, 1)),
+      _shards(std::max<size_t>(options.shards, 1)) {}
+
+QueryCache::Shard& QueryCache::shard_for(const std::string& key) {
+    return _shards[std::hash<std::string>()(key) % _shards.size()];
+}
+
+void QueryCache::erase(Shard& shard, std::list<Entry>::iterator itr) {
+    shard.bytes -= itr->bytes;
+    shard.index.erase(itr->key);
+    shard.lru.erase(itr);
+}
+
+// Fresh result cached under key, if any
+std::optional<Result> QueryCache::find(const std::string& key) {
+    Shard& shard = shard_for(key);
+    std::lock_guard lockGuard(shard.mutex);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+        ++shard.misses;
+        return std::nullopt;
+    }
+
+    auto itr = found->second;
+    if (_options.ttl.count() > 0 &&
+        itr->expires <= std::chrono::steady_clock::now()) {
+        erase(shard, itr);
+        ++shard.expirations;
+        ++shard.misses;
+        return std::nullopt;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, itr);
+    ++shard.hits;
+    return itr->result;
+}
+
+uint64_t QueryCache::generation() const {
+    return _generation.load(std::memory_order_acquire);
+}
+
+// Cache result under key unless something was invalidated meanwhile
+void QueryCache::insert(const std::string& key, const Result& result,
+                        std::initializer_list<std::string_view> tables,
+                        uint64_t generation) {
+    size_t bytes = key.size();
+    for (const auto& row : result) {
+        for (size_t col = 0; col < row.size(); ++col) {
+            bytes += row.view(int(col)).size();
+        }
+    }
+    if (bytes > _shardBytes) {
+        return;  // Would evict everything else and still not fit
+    }
+
+    Shard& shard = shard_for(key);
+    std::lock_guard lockGuard(shard.mutex);
+    // Checked under the lock: invalidate() bumps the generation first,
+    // then sweeps each shard under its lock
+    if (_generation.load(std::memory_order_acquire) != generation) {
+        return;
+    }
+
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+        erase(shard, found->second);
+    }
+    while (!shard.lru.empty() && shard.bytes + bytes > _shardBytes) {
+        erase(shard, std::prev(shard.lru.end()));
+        ++shard.evictions;
+    }
+
+    shard.lru.push_front(
+        Entry{key, result, std::chrono::steady_clock::now() + _options.ttl,
+              bytes, std::vector<std::string>(tables.begin(), tables.end())});
+    shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+    shard.bytes += bytes;
+}
+
+// Drop every entry that reads table
+size_t QueryCache::invalidate(std::string_view table) {
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    size_t dropped = 0;
+    for (auto& shard : _shards) {
+        std::lock_guard lockGuard(shard.mutex);
+        for (auto itr = shard.lru.begin(); itr != shard.lru.end();) {
+            const auto& tables = itr->tables;
+            if (std::find(tables.begin(), tables.end(), table) !=
+                tables.end()) {
+                erase(shard, itr++);
+                ++shard.invalidations;
+                ++dropped;
+            } else {
+                ++itr;
+            }
+        }
+    }
+    return dropped;
+}
+
+void QueryCache::clear() {
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    for (auto& shard : _shards) {
+        std::lock_guard lockGuard(shard.mutex);
+        shard.invalidations += shard.lru.size();
+        shard.index.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
+
+// Invalidate tables named by notifications on channel
+void QueryCache::invalidate_on(Subscriber& subscriber,
+                               const std::string& channel) {
+    std::weak_ptr<QueryCache> weak = weak_from_this();
+    if (weak.expired()) {
+        throw std::invalid_argument(
+            "QueryCache::invalidate_on() needs a cache owned by a "
+            "std::shared_ptr");
+    }
+    subscriber.listen(channel, [weak](const std::vector<Notification>& batch) {
+        auto cache = weak.lock();
+        if (!cache) {
+            return;
+        }
+        if (batch.empty()) {
+            cache->clear();  // Reconnected: anything may have changed
+            return;
+        }
+        // A burst often names the same table many times
+        std::unordered_set<std::string_view> tables;
+        for (const auto& notification : batch) {
+            if (tables.insert(notification.payload).second) {
+                cache->invalidate(notification.payload);
+            }
+        }
+    });
+}
+
+QueryCacheStats QueryCache::stats() const {
+    QueryCacheStats stats;
+    for (const auto& shard : _shards) {
+        std::lock_guard lockGuard(shard.mutex);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.expirations += shard.expirations;
+        stats.invalidations += shard.invalidations;
+        stats.entries += shard.lru.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
+
+namespace {
+
+std::string join_columns(const std::vector<std::string>& columns) {
+    std::string joined;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (i > 0) joined += ", ";
+        joined += columns[i];
+    }
+    return joined;
+}
+
+}  // namespace
+
+namespace detail {
+
+// INSERT INTO table (cols) VALUES ($1, $2), ($3, $4) ... [ON CONFLICT ...]
+std::string build_insert_sql(const std::string& table,
+                             const std::vector<std::string>& columns,
+                             size_t rows, const BatchInsertOptions& options) {
+    std::string sql = "INSERT INTO " + table + " (" + join_columns(columns) +
+                      ") VALUES ";
+    size_t param = 0;
+    for (size_t row = 0; row < rows; ++row) {
+        sql += row > 0 ? ", (" : "(";
+        for (size_t col = 0; col < columns.size(); ++col) {
+            if (col > 0) sql += ", ";
+            sql += "$" + std::to_string(++param);
+        }
+        sql += ")";
+    }
+
+    if (!options.conflictColumns.empty()) {
+        sql += " ON CONFLICT (" + join_columns(options.conflictColumns) + ")";
+        if (options.updateColumns.empty()) {
+            sql += " DO NOTHING";
+        } else {
+            sql += " DO UPDATE SET ";
+            for (size_t i = 0; i < options.updateColumns.size(); ++i) {
+                if (i > 0) sql += ", ";
+                sql += options.updateColumns[i] + " = EXCLUDED." +
+                       options.updateColumns[i];
+            }
+        }
+    }
+    return sql;
+}
+
+// Rows per statement, given PostgreSQL's limit of 65535 bind parameters
+size_t batch_rows(size_t columns, const BatchInsertOptions& options) {
+    const size_t maxRows = 65535 / columns;
+    return std::clamp<size_t>(options.batchRows, 1, maxRows);
+}
+
+}  // namespace detail
+
+Inserter::Inserter(Database& db, const std::string& table,
+                   const std::vector<std::string>& columns,
+                   const BulkInsertOptions& options)
+    : _db(&db),
+      _table(table),
+      _columns(join_columns(columns)),
+      _chunkRows(options.chunkRows) {}
+
+Inserter::Inserter(Transaction& txn, const std::string& table,
+                   const std::vector<std::string>& columns)
+    : _txn(&txn), _table(table), _columns(join_columns(columns)) {}
+
+Inserter::Inserter(Inserter&&) noexcept = default;
+Inserter& Inserter::operator=(Inserter&&) noexcept = default;
+
+// Rolls back the current chunk if finish() was not called
+Inserter::~Inserter() {
+    // Drop the stream first: it must not outlive its transaction
+    _stream.reset();
+}
+
+// End the COPY and commit the last chunk; returns total rows written
+size_t Inserter::finish() {
+    close_chunk();
+    return _rows;
+}
+
+// Start a COPY (and, for owned chunks, a transaction) if none is open
+void Inserter::open_chunk() {
+    if (_stream) {
+        return;
+    }
+    try {
+        if (_db) {
+            _chunkTxn = _db->new_transaction();
+        }
+        Transaction& txn = _db ? *_chunkTxn : *_txn;
+        _stream = std::make_unique<pqxx::stream_to>(
+            pqxx::stream_to::raw_table(*txn._txn, _table, _columns));
+    } catch (const DatabaseError&) {
+        throw;
+    } catch (const pqxx::sql_error& e) {
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+    _rowsInChunk = 0;
+}
+
+// Complete the COPY and commit an owned chunk
+void Inserter::close_chunk() {
+    if (!_stream) {
+        return;
+    }
+    try {
+        _stream->complete();
+        _stream.reset();
+    } catch (const pqxx::sql_error& e) {
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+    if (_chunkTxn) {
+        _chunkTxn->commit();
+        _chunkTxn.reset();
+    }
+}
+
+// Count a written row, rolling over to the next chunk when full
+void Inserter::row_written() {
+    ++_rows;
+    if (_chunkRows > 0 && ++_rowsInChunk >= _chunkRows) {
+        close_chunk();
+    }
+}
+
+namespace {
+
+template <pqxx::isolation_level Isolation>
+std::unique_ptr<pqxx::transaction_base> open_work(pqxx::connection& conn,
+                                                  bool readOnly) {
+    if (readOnly) {
+        return std::make_unique<
+            pqxx::transaction<Isolation, pqxx::write_policy::read_only>>(conn);
+    }
+    return std::make_unique<pqxx::transaction<Isolation>>(conn);
+}
+
+// BEGIN with the requested isolation level and access mode
+std::unique_ptr<pqxx::transaction_base> open_transaction(
+    pqxx::connection& conn, const TransactionOptions& options) {
+    std::unique_ptr<pqxx::transaction_base> txn;
+    switch (options.isolation) {
+        case IsolationLevel::ReadCommitted:
+            txn = open_work<pqxx::isolation_level::read_committed>(
+                conn, options.readOnly);
+            break;
+        case IsolationLevel::RepeatableRead:
+            txn = open_work<pqxx::isolation_level::repeatable_read>(
+                conn, options.readOnly);
+            break;
+        case IsolationLevel::Serializable:
+            txn = open_work<pqxx::isolation_level::serializable>(
+                conn, options.readOnly);
+            break;
+    }
+    // pqxx has no DEFERRABLE variant; this is still before the first query,
+    // so it applies to the whole transaction
+    if (options.deferrable) {
+        txn->exec("SET TRANSACTION DEFERRABLE");
+    }
+    return txn;
+}
+
+}  // namespace
+
+// Constructor with connection string
+Database::Database(const std::string& connectionString)
+    : _connectedAt(std::chrono::steady_clock::now()),
+      _checkedAt(_connectedAt) {
+    try {
+        _conn = std::make_unique<pqxx::connection>(connectionString);
+    } catch (const std::exception& e) {
+        throw ConnectionError(e.what());
+    }
+}
+
+// Constructor with individual parameters
+Database::Database(const std::string& host, const std::string& port,
+                   const std::string& dbname, const std::string& user,
+                   const std::string& password)
+    : _connectedAt(std::chrono::steady_clock::now()),
+      _checkedAt(_connectedAt) {
+    std::ostringstream oss;
+    oss << "host=" << host << " port=" << port << " dbname=" << dbname
+        << " user=" << user << " password=" << password;
+
+    try {
+        _conn = std::make_unique<pqxx::connection>(oss.str());
+    } catch (const std::exception& e) {
+        throw ConnectionError(e.what());
+    }
+}
+
+// Create transaction
+Transaction Database::begin_transaction(const TransactionOptions& options) {
+    if (!is_open()) {
+        throw ConnectionError("Connection is not open");
+    }
+    try {
+        return Transaction(open_transaction(*_conn, options), this);
+    } catch (const pqxx::sql_error& e) {
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+}
+
+// Explicit (BEGIN/COMMIT) transaction owned by the caller
+std::unique_ptr<Transaction> Database::new_transaction() {
+    if (!is_open()) {
+        throw ConnectionError("Connection is not open");
+    }
+    return std::unique_ptr<Transaction>(new Transaction(*_conn, this));
+}
+
+// Autocommit (pqxx::nontransaction) transaction owned by the caller
+std::unique_ptr<Transaction> Database::new_nontransaction() {
+    if (!is_open()) {
+        throw ConnectionError("Connection is not open");
+    }
+    return std::unique_ptr<Transaction>(new Transaction(
+        std::make_unique<pqxx::nontransaction>(*_conn), this));
+}
+
+// Batch statements over an autocommit connection
+Pipeline Database::pipeline() { return Pipeline(new_nontransaction()); }
+
+// Transaction for one exec*() call, according to the exec mode
+Transaction Database::begin_statement() {
+    if (_execMode == ExecMode::Transactional) {
+        return begin_transaction();
+    }
+    if (!is_open()) {
+        throw ConnectionError("Connection is not open");
+    }
+    return Transaction(std::make_unique<pqxx::nontransaction>(*_conn), this);
+}
+
+// Execute query without transaction (auto-commit)
+Result Database::exec(const std::string& sql) {
+    auto txn = begin_statement();
+    auto result = txn.exec(sql);
+    txn.commit();
+    return result;
+}
+
+// Prepare statement
+void Database::prepare(const std::string& name, const std::string& sql) {
+    try {
+        _conn->prepare(name, sql);
+        _preparedNames.insert(name);
+    } catch (const pqxx::sql_error& e) {
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+}
+
+void Database::enable_statement_cache(size_t capacity) {
+    if (_stmtCache && is_open()) {
+        // Drop what the old cache prepared; names are never reused
+        for (const auto& name : _stmtCache->clear()) {
+            try {
+                _conn->unprepare(name);
+            } catch (const std::exception&) {
+                // Connection gone; the statement went with it
+            }
+        }
+    }
+    _stmtCache =
+        capacity > 0 ? std::make_unique<StatementCache>(capacity) : nullptr;
+}
+
+StatementCacheStats Database::statement_cache_stats() const {
+    return _stmtCache ? _stmtCache->stats() : StatementCacheStats{};
+}
+
+void Database::set_prepared_registry(
+    std::shared_ptr<const PreparedRegistry> registry) {
+    _registry = std::move(registry);
+}
+
+void Database::set_observer(std::shared_ptr<Observer> observer) {
+    _observer = std::move(observer);
+}
+
+void Database::set_query_cache(std::shared_ptr<QueryCache> cache) {
+    _queryCache = std::move(cache);
+}
+
+// Prepare name from the registry if this connection hasn't yet
+void Database::ensure_prepared(const std::string& name) {
+    if (!_registry || _preparedNames.count(name) > 0) {
+        return;
+    }
+    if (auto sql = _registry->find(name)) {
+        prepare(name, *sql);
+    }
+}
+
+// Prepare a Statement's SQL if this connection hasn't yet
+void Database::ensure_prepared(uint64_t hash, const char* name,
+                               const char* sql) {
+    auto it = _preparedStatements.find(hash);
+    if (it != _preparedStatements.end()) {
+        PreparedStatement& prepared = it->second;
+        if (prepared.source != sql) {
+            if (prepared.sql != sql) {
+                throw std::invalid_argument(
+                    std::string("Statement name ") + name +
+                    " is already prepared with different SQL");
+            }
+            prepared.source = sql;
+        }
+        return;
+    }
+    try {
+        _conn->prepare(name, sql);
+        _preparedStatements.emplace(hash, PreparedStatement{sql, sql});
+    } catch (const pqxx::sql_error& e) {
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+}
+
+// SQL for name if it is registered but not yet prepared here; marks it
+// prepared, for callers that PREPARE it in-band
+std::optional<std::string> Database::take_unprepared(const std::string& name) {
+    if (!_registry || _preparedNames.count(name) > 0) {
+        return std::nullopt;
+    }
+    auto sql = _registry->find(name);
+    if (sql) {
+        _preparedNames.insert(name);
+    }
+    return sql;
+}
+
+// Name of the cached statement for sql, preparing it on a miss
+const std::string& Database::cached_statement(const std::string& sql) {
+    if (const std::string* name = _stmtCache->find(sql)) {
+        return *name;
+    }
+
+    std::string name = "pgw_stmt_" + std::to_string(++_stmtCounter);
+    prepare(name, sql);
+
+    std::optional<std::string> evicted;
+    const std::string& cached =
+        _stmtCache->insert(sql, std::move(name), evicted);
+    if (evicted) {
+        try {
+            _conn->unprepare(*evicted);
+        } catch (const std::exception&) {
+            // Leaves the statement allocated server-side until disconnect
+        }
+    }
+    return cached;
 }
 
 // Check if table exists
@@ -292,99 +2023,1675 @@ bool Database::table_exists(const std::string& tableName) {
     return result.front().get<bool>(0);
 }
 
-// Get table column names
-std::vector<std::string> Database::get_columns(const std::string& tableName) {
-    auto result = exec_params(
-        "SELECT column_name FROM information_schema.columns WHERE "
-        "table_name = "
-        "$1 ORDER BY ordinal_position",
-        tableName);
+// Get table column names
+std::vector<std::string> Database::get_columns(const std::string& tableName) {
+    auto result = exec_params(
+        "SELECT column_name FROM information_schema.columns WHERE "
+        "table_name = "
+        "$1 ORDER BY ordinal_position",
+        tableName);
+
+    std::vector<std::string> columns;
+    for (const auto& row : result) {
+        columns.push_back(row.get<std::string>(0));
+    }
+    return columns;
+}
+
+// Name of the prepared INSERT with this shape, preparing it on first use
+const std::string& Database::insert_statement(
+    const std::string& table, const std::vector<std::string>& columns,
+    size_t rows, const BatchInsertOptions& options) {
+    // Unit separators keep distinct shapes from joining to the same key
+    std::string key = table;
+    for (const auto& column : columns) {
+        key += '\x1f' + column;
+    }
+    key += '\x1e' + std::to_string(rows);
+    for (const auto& column : options.conflictColumns) {
+        key += '\x1f' + column;
+    }
+    key += '\x1e';
+    for (const auto& column : options.updateColumns) {
+        key += '\x1f' + column;
+    }
+
+    if (const std::string* name = _insertStatements.find(key)) {
+        return *name;
+    }
+
+    std::string name = "pgw_insert_" + std::to_string(++_stmtCounter);
+    prepare(name, detail::build_insert_sql(table, columns, rows, options));
+
+    // Bounded like the exec_params() cache, so callers with many shapes
+    // don't pile up statements on the server
+    std::optional<std::string> evicted;
+    const std::string& cached =
+        _insertStatements.insert(key, std::move(name), evicted);
+    if (evicted) {
+        try {
+            _conn->unprepare(*evicted);
+            _preparedNames.erase(*evicted);
+        } catch (const std::exception&) {
+            // Leaves the statement allocated server-side until disconnect
+        }
+    }
+    return cached;
+}
+
+// Whether the server end is still there, without a round trip
+bool Database::is_alive() {
+    if (!is_open()) {
+        return false;
+    }
+#ifndef _WIN32
+    pollfd pfd{};
+    pfd.fd = _conn->sock();
+    pfd.events = POLLIN;
+    if (::poll(&pfd, 1, 0) == 0) {
+        // Nothing to read on an idle connection: the usual case
+        _checkedAt = std::chrono::steady_clock::now();
+        return true;
+    }
+#endif
+    // Something arrived: a notice, a notification, or the server's final
+    // error followed by EOF. Let libpq read it and decide.
+    try {
+        _conn->get_notifs();
+    } catch (const std::exception&) {
+        close();
+        return false;
+    }
+    if (!_conn->is_open()) {
+        close();
+        return false;
+    }
+    _checkedAt = std::chrono::steady_clock::now();
+    return true;
+}
+
+// Round-trip liveness check
+bool Database::ping() {
+    try {
+        exec("SELECT 1");
+    } catch (const DatabaseError&) {
+        close();
+        return false;
+    }
+    _checkedAt = std::chrono::steady_clock::now();
+    return true;
+}
+
+// Socket of the connection, for an event loop
+int Database::socket() const {
+    if (!is_open()) {
+        throw ConnectionError("Connection is not open");
+    }
+    return _conn->sock();
+}
+
+// Roll back any transaction still open on this connection
+void Database::reset() {
+    if (_activeTxn) {
+        try {
+            _activeTxn->abort();
+        } catch (...) {
+            // A failed rollback leaves the connection unusable; callers
+            // check is_open() afterwards
+        }
+    }
+}
+
+// COPY rows into table; prefer this to insert() for bulk loads
+Inserter Database::inserter(const std::string& table,
+                            const std::vector<std::string>& columns,
+                            const BulkInsertOptions& options) {
+    return Inserter(*this, table, columns, options);
+}
+
+// Close connection
+void Database::close() {
+    if (_stmtCache) {
+        _stmtCache->clear();  // Server-side statements die with the session
+    }
+    _preparedNames.clear();
+    _preparedStatements.clear();
+    _insertStatements.clear();
+    if (_conn) {
+        _conn.reset();  // _conn->close();
+    }
+}
+
+std::chrono::nanoseconds PoolStats::average_wait_time() const {
+    if (acquisitions == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    return totalWaitTime / static_cast<int64_t>(acquisitions);
+}
+
+PooledConnection::PooledConnection(ConnectionPool* pool,
+                                   std::unique_ptr<Database> conn)
+    : _pool(pool), _conn(std::move(conn)) {}
+
+PooledConnection::PooledConnection(PooledConnection&& other) noexcept
+    : _pool(other._pool), _conn(std::move(other._conn)) {
+    other._pool = nullptr;
+}
+
+PooledConnection& PooledConnection::operator=(
+    PooledConnection&& other) noexcept {
+    if (this != &other) {
+        release();
+        _pool = other._pool;
+        _conn = std::move(other._conn);
+        other._pool = nullptr;
+    }
+    return *this;
+}
+
+PooledConnection::~PooledConnection() { release(); }
+
+// Return the connection to the pool before the lease goes out of scope
+void PooledConnection::release() {
+    if (_pool && _conn) {
+        try {
+            _pool->return_connection(std::move(_conn));
+        } catch (...) {
+            // Never throw from a lease; the pool drops what it can't keep
+        }
+    }
+    _pool = nullptr;
+    _conn.reset();
+}
+
+ConnectionPool::ConnectionPool(const std::string& connectionString,
+                               size_t maxConnections)
+    : ConnectionPool(connectionString, PoolOptions{maxConnections}) {}
+
+ConnectionPool::ConnectionPool(const std::string& connectionString,
+                               const PoolOptions& options)
+    : _connectionString(with_keepalive(connectionString, options.keepalive)),
+      _options(options),
+      _registry(std::make_shared<PreparedRegistry>()),
+      _maxConnections(options.maxConnections) {
+    _options.minIdle = std::min(_options.minIdle, _maxConnections);
+    _pool.reserve(_maxConnections);
+    _stats.maxConnections = _maxConnections;
+
+    if (_options.mode == PoolMode::ThreadAffinity) {
+        _slotCount = _options.affinitySlots > 0
+                         ? _options.affinitySlots
+                         : std::max(1u, std::thread::hardware_concurrency());
+        _slots = std::make_unique<AffinitySlot[]>(_slotCount);
+        _freeList =
+            std::make_unique<detail::MpmcQueue<Database*>>(_maxConnections);
+    }
+
+    // Warm up, so the first requests don't each pay for a handshake.
+    // Best effort: the maintenance thread retries whatever fails here.
+    for (size_t i = 0; i < _options.minIdle; ++i) {
+        try {
+            _pool.push_back(
+                {open_connection(), std::chrono::steady_clock::now()});
+            ++_currentConnections;
+            notify(PoolEventKind::Opened);
+        } catch (const DatabaseError&) {
+            break;
+        }
+    }
+
+    _worker = std::thread(&ConnectionPool::run_maintenance, this);
+}
+
+ConnectionPool::~ConnectionPool() {
+    {
+        std::lock_guard lockGuard(_mutex);
+        _stopping = true;
+    }
+    _workerCv.notify_all();
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+
+    while (take_cached(true)) {
+        // Destroys each cached connection
+    }
+
+    std::lock_guard lockGuard(_mutex);
+    _pool.clear();  // ensures cleanup
+}
+
+std::unique_ptr<Database> ConnectionPool::get_connection() {
+    if (_waiterCount.load() == 0) {
+        if (auto conn = take_cached(false)) {
+            _fastAcquisitions.fetch_add(1, std::memory_order_relaxed);
+            return checked(std::move(conn));
+        }
+    }
+
+    std::unique_lock lock(_mutex);
+
+    // Don't jump ahead of threads already blocked in acquire()
+    if (!_waiters.empty()) {
+        return nullptr;
+    }
+
+    // If there's an available one in the pool, return it
+    if (!_pool.empty()) {
+        auto conn = std::move(_pool.back().conn);
+        _pool.pop_back();
+        record_wait(std::chrono::nanoseconds(0));
+        lock.unlock();
+        return checked(std::move(conn));
+    }
+
+    // Idle in another thread's affinity slot
+    if (auto conn = take_cached(true)) {
+        record_wait(std::chrono::nanoseconds(0));
+        lock.unlock();
+        return checked(std::move(conn));
+    }
+
+    // If we haven't reached the max, create a new one
+    if (_currentConnections < _maxConnections) {
+        ++_currentConnections;
+        record_wait(std::chrono::nanoseconds(0));
+        lock.unlock();
+        return open_reserved();
+    }
+
+    // Pool exhausted
+    return nullptr;
+}
+
+std::unique_ptr<Database> ConnectionPool::acquire(
+    std::chrono::milliseconds timeout) {
+    const auto start = std::chrono::steady_clock::now();
+
+    if (_waiterCount.load() == 0) {
+        if (auto conn = take_cached(false)) {
+            _fastAcquisitions.fetch_add(1, std::memory_order_relaxed);
+            return checked(std::move(conn));
+        }
+    }
+
+    std::unique_lock lock(_mutex);
+
+    std::unique_ptr<Database> conn;
+    if (_waiters.empty() && !_pool.empty()) {
+        conn = std::move(_pool.back().conn);
+        _pool.pop_back();
+    } else if (_waiters.empty() && (conn = take_cached(true))) {
+        // Idle in another thread's affinity slot
+    } else if (_waiters.empty() && _currentConnections < _maxConnections) {
+        ++_currentConnections;
+    } else {
+        // Queue up behind earlier waiters until a connection is handed over
+        Waiter waiter;
+        _waiters.push_back(&waiter);
+        _waiterCount.fetch_add(1);
+        ++_stats.waits;
+
+        // Pairs with the fence in park_cached(): a connection parked before
+        // it saw our _waiterCount increment is picked up here
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if ((waiter.conn = take_cached(true))) {
+            waiter.ready = true;
+            _waiters.erase(
+                std::find(_waiters.begin(), _waiters.end(), &waiter));
+            _waiterCount.fetch_sub(1);
+        }
+
+        if (!waiter.cv.wait_until(lock, start + timeout,
+                                  [&waiter] { return waiter.ready; })) {
+            _waiters.erase(
+                std::find(_waiters.begin(), _waiters.end(), &waiter));
+            _waiterCount.fetch_sub(1);
+            ++_stats.timeouts;
+            notify(PoolEventKind::TimedOut,
+                   std::chrono::steady_clock::now() - start);
+            throw PoolTimeoutError("Timed out waiting for a pooled connection");
+        }
+        conn = std::move(waiter.conn);
+    }
+
+    record_wait(std::chrono::steady_clock::now() - start);
+
+    if (conn) {
+        lock.unlock();
+        return checked(std::move(conn));
+    }
+
+    // We own a free slot; open a connection for it without the lock
+    lock.unlock();
+    return open_reserved();
+}
+
+// Check-on-borrow, replacing conn in its slot if it died
+std::unique_ptr<Database> ConnectionPool::checked(
+    std::unique_ptr<Database> conn) {
+    if (!_options.validateOnBorrow ||
+        std::chrono::steady_clock::now() - conn->checked_at() <
+            _options.validateInterval ||
+        conn->is_alive()) {
+        return conn;
+    }
+
+    conn.reset();
+    {
+        std::lock_guard lockGuard(_mutex);
+        ++_stats.replacedConnections;
+        notify(PoolEventKind::Broken);
+    }
+    return open_reserved();
+}
+
+PooledConnection ConnectionPool::lease(std::chrono::milliseconds timeout) {
+    return PooledConnection(this, acquire(timeout));
+}
+
+void ConnectionPool::return_connection(std::unique_ptr<Database> conn) {
+    // Cheap validation outside the lock: roll back a leftover transaction
+    // and close connections past their lifetime
+    if (conn) {
+        conn->reset();
+        if (expired(*conn, std::chrono::steady_clock::now())) {
+            conn.reset();
+            std::lock_guard lockGuard(_mutex);
+            ++_stats.retiredConnections;
+            notify(PoolEventKind::Retired);
+            release_slot();
+            return;
+        }
+        if (conn->is_open() && park_cached(conn)) {
+            return;
+        }
+    }
+
+    std::lock_guard lockGuard(_mutex);
+
+    if (!conn) {
+        // Caller dropped the connection, pass its slot to a waiter if any
+        release_slot();
+        return;
+    }
+
+    if (!conn->is_open()) {
+        // Keep the slot reserved and reopen it in the background
+        ++_pendingOpens;
+        ++_stats.replacedConnections;
+        notify(PoolEventKind::Broken);
+        _workerCv.notify_one();
+        return;
+    }
+
+    // Wake exactly one waiter, handing it this connection directly
+    if (hand_off(conn)) {
+        return;
+    }
+
+    if (_pool.size() < _maxConnections) {
+        _pool.push_back({std::move(conn), std::chrono::steady_clock::now()});
+    } else {
+        // Pool full — destroy the extra connection
+        --_currentConnections;
+    }
+}
+
+PoolStats ConnectionPool::stats() const {
+    std::lock_guard lockGuard(_mutex);
+    PoolStats stats = _stats;
+    stats.totalConnections = _currentConnections;
+    stats.idleConnections = _pool.size() + _cachedCount.load();
+    stats.acquisitions += _fastAcquisitions.load();
+    stats.waitingThreads = _waiters.size();
+    return stats;
+}
+
+// Make a prepared statement available on every pooled connection,
+// current and future. Each connection prepares it on first use.
+void ConnectionPool::register_prepared(const std::string& name,
+                                       const std::string& sql) {
+    _registry->add(name, sql);
+}
+
+namespace {
+
+// WHERE conditions splitting table into at most partitions parts, as seen
+// by txn's snapshot
+std::vector<std::string> scan_ranges(Transaction& txn,
+                                     const std::string& table,
+                                     const std::string& keyColumn,
+                                     size_t partitions) {
+    std::vector<std::string> ranges;
+    if (keyColumn.empty()) {
+        // No VACUUM truncation drops pages with rows the snapshot can see,
+        // and later pages only hold newer rows, so the last range is open
+        const Result size = txn.exec(
+            "SELECT pg_relation_size(" + txn.quote(table) +
+            ") / current_setting('block_size')::bigint, "
+            "current_setting('server_version_num')::int");
+        const auto blocks = size.front().get<int64_t>(0);
+        if (size.front().get<int>(1) < 140000) {
+            // ctid conditions need PostgreSQL 14's TID range scans; before
+            // that every partition would read the whole table
+            ranges.push_back("TRUE");
+            return ranges;
+        }
+        const uint64_t total = blocks > 0 ? blocks : 1;
+        const size_t count = std::min<uint64_t>(partitions, total);
+        const auto bound = [&](size_t i) {
+            return "'(" + std::to_string(total * i / count) + ",0)'::tid";
+        };
+        for (size_t i = 0; i < count; ++i) {
+            std::string where;
+            if (i > 0) {
+                where = "ctid >= " + bound(i);
+            }
+            if (i + 1 < count) {
+                where += (where.empty() ? "ctid < " : " AND ctid < ") +
+                         bound(i + 1);
+            }
+            ranges.push_back(where.empty() ? "TRUE" : where);
+        }
+        return ranges;
+    }
+
+    const Result minMax = txn.exec("SELECT min(" + keyColumn +
+                                   ")::bigint, max(" + keyColumn +
+                                   ")::bigint FROM " + table);
+    const auto low = minMax.front().get_optional<int64_t>(0);
+    const auto high = minMax.front().get_optional<int64_t>(1);
+    if (!low || !high) {
+        // Empty, or every key is NULL
+        ranges.push_back(keyColumn + " IS NULL");
+        return ranges;
+    }
+
+    // Computed in unsigned arithmetic so the full int64 range can't
+    // overflow
+    const uint64_t span = static_cast<uint64_t>(*high) -
+                          static_cast<uint64_t>(*low);
+    const size_t count = span < partitions ? span + 1 : partitions;
+    const auto bound = [&](size_t i) {
+        const uint64_t offset =
+            span < partitions
+                ? i
+                : span / count * i + span % count * i / count;
+        return std::to_string(
+            static_cast<int64_t>(static_cast<uint64_t>(*low) + offset));
+    };
+    for (size_t i = 0; i < count; ++i) {
+        std::string where;
+        if (i > 0) {
+            where = keyColumn + " >= " + bound(i);
+        }
+        if (i + 1 < count) {
+            where += (where.empty() ? "" : " AND ") + keyColumn + " < " +
+                     bound(i + 1);
+        }
+        if (i == 0) {
+            where = count == 1 ? "TRUE"
+                               : "(" + where + " OR " + keyColumn +
+                                     " IS NULL)";
+        }
+        ranges.push_back(std::move(where));
+    }
+    return ranges;
+}
+
+// Read one partition through a cursor, batchRows rows per callback
+size_t scan_partition(Transaction& txn, const std::string& select,
+                      size_t partition, const ParallelScanOptions& options,
+                      const ScanCallback& callback,
+                      const std::atomic<bool>& stop) {
+    txn.exec("DECLARE pgw_scan NO SCROLL CURSOR FOR " + select);
+    const std::string fetch = "FETCH FORWARD " +
+                              std::to_string(options.batchRows) +
+                              " FROM pgw_scan";
+    size_t rows = 0;
+    while (!stop) {
+        Result batch = txn.exec(fetch);
+        if (batch.empty()) {
+            break;
+        }
+        rows += batch.size();
+        callback(partition, batch);
+    }
+    txn.exec("CLOSE pgw_scan");
+    return rows;
+}
+
+}  // namespace
+
+// Scan table in partitions on several connections sharing one snapshot
+size_t ConnectionPool::parallel_scan(const std::string& table,
+                                     const std::string& keyColumn,
+                                     size_t partitions,
+                                     const ScanCallback& callback,
+                                     const ParallelScanOptions& options) {
+    if (partitions == 0 || options.batchRows == 0) {
+        throw std::invalid_argument(
+            "parallel_scan needs at least one partition and batch row");
+    }
+    const TransactionOptions snapshotOptions{IsolationLevel::RepeatableRead,
+                                             true};
+
+    // The exporting transaction must stay open until every worker has
+    // imported its snapshot, so it scans partitions too rather than wait
+    PooledConnection coordinator = lease(options.leaseTimeout);
+    Transaction txn = coordinator->begin_transaction(snapshotOptions);
+    const auto snapshot = txn.exec("SELECT pg_export_snapshot()")
+                              .front()
+                              .get<std::string>(0);
+    const auto ranges = scan_ranges(txn, table, keyColumn, partitions);
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> total{0};
+    std::atomic<bool> stop{false};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    const auto work = [&](Transaction& scanTxn) {
+        for (size_t i; !stop && (i = next++) < ranges.size();) {
+            total += scan_partition(scanTxn,
+                                    "SELECT " + options.columns + " FROM " +
+                                        table + " WHERE " + ranges[i],
+                                    i, options, callback, stop);
+        }
+    };
+    const auto finished = [&] { return stop || next >= ranges.size(); };
+    const auto fail = [&] {
+        std::lock_guard lockGuard(errorMutex);
+        if (!error) {
+            error = std::current_exception();
+        }
+        stop = true;
+    };
+
+    const size_t workers = std::min(
+        options.workers == 0 ? ranges.size() : options.workers, ranges.size());
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    try {
+        for (size_t w = 1; w < workers && !finished(); ++w) {
+            // Only connections free right now: a worker blocked in acquire()
+            // would hold up the join long after the others had finished
+            auto free = get_connection();
+            if (!free) {
+                break;
+            }
+            PooledConnection lent(this, std::move(free));
+            threads.emplace_back([&, conn = std::move(lent)] {
+                try {
+                    // Don't import the snapshot once the other workers have
+                    // claimed everything
+                    if (finished()) {
+                        return;
+                    }
+                    Transaction scanTxn =
+                        conn->begin_transaction(snapshotOptions);
+                    scanTxn.exec("SET TRANSACTION SNAPSHOT " +
+                                 scanTxn.quote(snapshot));
+                    work(scanTxn);
+                    scanTxn.commit();
+                } catch (...) {
+                    fail();
+                }
+            });
+        }
+        work(txn);
+    } catch (...) {
+        fail();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    txn.commit();
+    return total;
+}
+
+// Open and configure a new connection
+std::unique_ptr<Database> ConnectionPool::open_connection() const {
+    auto conn = std::make_unique<Database>(_connectionString);
+    conn->set_prepared_registry(_registry);
+    conn->set_observer(_options.observer);
+    conn->set_query_cache(_options.queryCache);
+    if (_options.statementCacheSize > 0) {
+        // Fresh cache: replacement connections re-prepare lazily
+        conn->enable_statement_cache(_options.statementCacheSize);
+    }
+    return conn;
+}
+
+std::unique_ptr<Database> ConnectionPool::open_reserved() {
+    std::unique_ptr<Database> conn;
+    try {
+        conn = open_connection();
+    } catch (...) {
+        std::lock_guard lockGuard(_mutex);
+        release_slot();
+        throw;
+    }
+    if (_options.observer) {
+        std::lock_guard lockGuard(_mutex);
+        notify(PoolEventKind::Opened);
+    }
+    return conn;
+}
+
+// Must be called with _mutex held
+bool ConnectionPool::hand_off(std::unique_ptr<Database>& conn) {
+    if (_waiters.empty()) {
+        return false;
+    }
+    Waiter* waiter = _waiters.front();
+    _waiters.pop_front();
+    _waiterCount.fetch_sub(1);
+    waiter->conn = std::move(conn);
+    waiter->ready = true;
+    // Notify under the lock: the waiter owns the condition variable
+    waiter->cv.notify_one();
+    return true;
+}
+
+// Must be called with _mutex held
+void ConnectionPool::make_available(std::unique_ptr<Database> conn) {
+    if (!hand_off(conn)) {
+        _pool.push_back({std::move(conn), std::chrono::steady_clock::now()});
+    }
+}
+
+// Must be called with _mutex held
+void ConnectionPool::release_slot() {
+    std::unique_ptr<Database> none;
+    if (!hand_off(none)) {
+        --_currentConnections;
+    }
+}
+
+bool ConnectionPool::expired(const Database& conn,
+                             std::chrono::steady_clock::time_point now) const {
+    return _options.maxLifetime.count() > 0 &&
+           now - conn.connected_at() >= _options.maxLifetime;
+}
+
+// Must be called with _mutex held
+void ConnectionPool::record_wait(std::chrono::nanoseconds waited) {
+    ++_stats.acquisitions;
+    _stats.totalWaitTime += waited;
+    _stats.maxWaitTime = std::max(_stats.maxWaitTime, waited);
+    notify(PoolEventKind::Acquired, waited);
+}
+
+// Must be called with _mutex held
+void ConnectionPool::notify(PoolEventKind kind,
+                            std::chrono::nanoseconds wait) {
+    if (!_options.observer) {
+        return;
+    }
+    PoolEvent event;
+    event.kind = kind;
+    event.wait = wait;
+    event.totalConnections = _currentConnections;
+    event.idleConnections = _pool.size() + _cachedCount.load();
+    event.waitingThreads = _waiters.size();
+    _options.observer->on_pool(event);
+}
+
+// Background thread: reopens broken connections, keeps minIdle
+// connections ready and retires old or long-idle ones
+void ConnectionPool::run_maintenance() {
+    auto backoff = _options.reconnectBackoff;
+
+    std::unique_lock lock(_mutex);
+    while (!_stopping) {
+        auto retired = take_expired();
+        if (!retired.empty()) {
+            lock.unlock();
+            retired.clear();  // Close sockets without holding the lock
+            lock.lock();
+        }
+
+        if (_options.idleProbeInterval.count() > 0) {
+            probe_idle(lock);
+        }
+
+        // Reserve slots to bring the idle list back up to minIdle
+        while (_pool.size() + _cachedCount.load() + _pendingOpens <
+                   _options.minIdle &&
+               _currentConnections < _maxConnections) {
+            ++_currentConnections;
+            ++_pendingOpens;
+        }
+
+        if (_pendingOpens == 0) {
+            _workerCv.wait_for(lock, _options.maintenanceInterval, [this] {
+                return _stopping || _pendingOpens > 0;
+            });
+            continue;
+        }
+
+        // Connect without holding the pool lock
+        lock.unlock();
+        std::unique_ptr<Database> conn;
+        try {
+            conn = open_connection();
+        } catch (const DatabaseError&) {
+            // Server unreachable; retry with backoff
+        }
+        lock.lock();
+
+        if (!conn) {
+            _workerCv.wait_for(lock, backoff, [this] { return _stopping; });
+            backoff = std::min(backoff * 2, _options.maxReconnectBackoff);
+            continue;
+        }
+
+        backoff = _options.reconnectBackoff;
+        --_pendingOpens;
+        notify(PoolEventKind::Opened);
+        make_available(std::move(conn));
+    }
+}
+
+// Must be called with _mutex held
+std::vector<std::unique_ptr<Database>> ConnectionPool::take_expired() {
+    std::vector<std::unique_ptr<Database>> retired;
+    const auto now = std::chrono::steady_clock::now();
+
+    // Past max lifetime: always retired
+    size_t kept = 0;
+    for (auto& idle : _pool) {
+        if (expired(*idle.conn, now)) {
+            retired.push_back(std::move(idle.conn));
+        } else {
+            if (&_pool[kept] != &idle) {
+                _pool[kept] = std::move(idle);
+            }
+            ++kept;
+        }
+    }
+    _pool.erase(_pool.begin() + kept, _pool.end());
+
+    // Idle too long: retired oldest first, down to minIdle
+    if (_options.idleTimeout.count() > 0) {
+        size_t stale = 0;
+        while (stale < _pool.size() &&
+               _pool.size() - stale > _options.minIdle &&
+               now - _pool[stale].idleSince >= _options.idleTimeout) {
+            retired.push_back(std::move(_pool[stale].conn));
+            ++stale;
+        }
+        _pool.erase(_pool.begin(), _pool.begin() + stale);
+    }
+
+    _currentConnections -= retired.size();
+    _stats.retiredConnections += retired.size();
+    for (size_t i = 0; i < retired.size(); ++i) {
+        notify(PoolEventKind::Retired);
+    }
+    return retired;
+}
+
+// SELECT 1 on every idle connection due for a probe, in one round trip
+void ConnectionPool::probe_idle(std::unique_lock<std::mutex>& lock) {
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<IdleConnection> probing;
+    size_t kept = 0;
+    for (auto& idle : _pool) {
+        if (now - idle.conn->checked_at() >= _options.idleProbeInterval) {
+            probing.push_back(std::move(idle));
+        } else {
+            if (&_pool[kept] != &idle) {
+                _pool[kept] = std::move(idle);
+            }
+            ++kept;
+        }
+    }
+    _pool.erase(_pool.begin() + kept, _pool.end());
+    if (probing.empty()) {
+        return;
+    }
 
-    std::vector<std::string> columns;
-    for (const auto& row : result) {
-        columns.push_back(row.get<std::string>(0));
+    lock.unlock();
+    // Send every probe before waiting for any reply
+    std::vector<std::optional<Pipeline>> pipelines(probing.size());
+    std::vector<QueryHandle> handles(probing.size());
+    for (size_t i = 0; i < probing.size(); ++i) {
+        try {
+            pipelines[i].emplace(probing[i].conn->pipeline());
+            handles[i] = pipelines[i]->exec("SELECT 1");
+            pipelines[i]->poll();
+        } catch (const std::exception&) {
+            pipelines[i].reset();
+        }
+    }
+    std::vector<bool> alive(probing.size(), false);
+    for (size_t i = 0; i < probing.size(); ++i) {
+        try {
+            if (pipelines[i]) {
+                pipelines[i]->get(handles[i]);
+                alive[i] = true;
+            }
+        } catch (const std::exception&) {
+            // Dead or unusable; reopened below
+        }
+        pipelines[i].reset();  // Ends its transaction
+        if (alive[i]) {
+            probing[i].conn->_checkedAt = std::chrono::steady_clock::now();
+        } else {
+            probing[i].conn.reset();
+        }
+    }
+    lock.lock();
+
+    for (auto& idle : probing) {
+        if (!idle.conn) {
+            // Keep the slot and reopen it on this thread's next pass
+            ++_pendingOpens;
+            ++_stats.replacedConnections;
+            notify(PoolEventKind::Broken);
+        } else if (!hand_off(idle.conn)) {
+            // Back in idle order, so idleTimeout still applies
+            auto pos = std::upper_bound(
+                _pool.begin(), _pool.end(), idle.idleSince,
+                [](auto since, const IdleConnection& other) {
+                    return since < other.idleSince;
+                });
+            _pool.insert(pos, std::move(idle));
+        }
     }
-    return columns;
 }
 
-// Simple insert helper
-template <typename... Args>
-void Database::insert(const std::string& table,
-                      const std::vector<std::string>& columns,
-                      Args&&... values) {
-    if (sizeof...(values) != columns.size()) {
-        throw std::invalid_argument(
-            "Number of values doesn't match number of columns");
+bool ConnectionPool::park_cached(std::unique_ptr<Database>& conn) {
+    if (!_slots) {
+        return false;
+    }
+
+    // Count first so a concurrent take_cached() never sees it underflow
+    _cachedCount.fetch_add(1);
+
+    Database* raw = conn.get();
+    Database* empty = nullptr;
+    auto& slot = _slots[thread_slot_hint() % _slotCount].conn;
+    if (!slot.compare_exchange_strong(empty, raw) &&
+        !_freeList->try_push(raw)) {
+        _cachedCount.fetch_sub(1);
+        return false;
+    }
+    conn.release();
+
+    // Pairs with the fence in acquire(): either it sees the connection we
+    // just published or we see its _waiterCount increment. The free list's
+    // release store alone would let both sides miss each other.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_waiterCount.load() == 0) {
+        return true;
+    }
+    conn = take_cached(true);
+    return !conn;
+}
+
+std::unique_ptr<Database> ConnectionPool::take_cached(bool anySlot) {
+    if (!_slots) {
+        return nullptr;
+    }
+
+    const size_t home = thread_slot_hint() % _slotCount;
+    Database* raw = _slots[home].conn.exchange(nullptr);
+    if (!raw && !_freeList->try_pop(raw)) {
+        raw = nullptr;
+        for (size_t i = 1; anySlot && !raw && i < _slotCount; ++i) {
+            raw = _slots[(home + i) % _slotCount].conn.exchange(nullptr);
+        }
+    }
+    if (!raw) {
+        return nullptr;
+    }
+    _cachedCount.fetch_sub(1);
+    return std::unique_ptr<Database>(raw);
+}
+
+namespace {
+
+inline bool is_word_char(char ch) {
+    return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_' ||
+           ch == '$';
+}
+
+// One FNV-1a step
+inline void hash_char(uint64_t& hash, char ch) {
+    hash = (hash ^ static_cast<unsigned char>(ch)) * detail::kFnvPrime;
+}
+
+inline size_t bit_width(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+#else
+    size_t width = 0;
+    for (; value != 0; value >>= 1) {
+        ++width;
     }
+    return width;
+#endif
+}
 
+std::string format_seconds(uint64_t nanos) {
     std::ostringstream oss;
-    oss << "INSERT INTO " << table << " (";
-    for (size_t i = 0; i < columns.size(); ++i) {
-        if (i > 0) oss << ", ";
-        oss << columns[i];
+    oss << static_cast<double>(nanos) / 1e9;
+    return oss.str();
+}
+
+}  // namespace
+
+// Hash of sql with literals replaced and whitespace and case normalized
+uint64_t fingerprint_sql(std::string_view sql) {
+    uint64_t hash = detail::kFnvOffset;
+    bool pendingSpace = false;
+    char prev = ' ';  // Last character hashed
+
+    for (size_t i = 0; i < sql.size();) {
+        const char ch = sql[i];
+        if (std::isspace(static_cast<unsigned char>(ch))) {
+            pendingSpace = true;
+            ++i;
+            continue;
+        }
+        if (pendingSpace) {
+            hash_char(hash, ' ');
+            pendingSpace = false;
+        }
+
+        if (ch == '\'') {
+            // String literal, with '' escapes
+            for (++i; i < sql.size(); ++i) {
+                if (sql[i] == '\'') {
+                    if (i + 1 < sql.size() && sql[i + 1] == '\'') {
+                        ++i;
+                    } else {
+                        ++i;
+                        break;
+                    }
+                }
+            }
+            hash_char(hash, prev = '?');
+        } else if (std::isdigit(static_cast<unsigned char>(ch)) &&
+                   !is_word_char(prev)) {
+            // Numeric literal
+            while (i < sql.size() &&
+                   (std::isalnum(static_cast<unsigned char>(sql[i])) ||
+                    sql[i] == '.')) {
+                ++i;
+            }
+            hash_char(hash, prev = '?');
+        } else {
+            prev = static_cast<char>(
+                std::tolower(static_cast<unsigned char>(ch)));
+            hash_char(hash, prev);
+            ++i;
+        }
     }
-    oss << ") VALUES (";
-    for (size_t i = 0; i < columns.size(); ++i) {
-        if (i > 0) oss << ", ";
-        oss << "$" << (i + 1);
+    return hash;
+}
+
+size_t LatencyHistogram::bucket_for(uint64_t value) {
+    // Values below 2 * kSubBuckets get a bucket each; above that, the top
+    // four significant bits pick the bucket within the power of two
+    if (value < 2 * kSubBuckets) {
+        return value;
     }
-    oss << ")";
+    const size_t width = bit_width(value);
+    const size_t shift = width - 4;
+    const size_t sub = (value >> shift) & (kSubBuckets - 1);
+    return std::min((width - 3) * kSubBuckets + sub, kBuckets - 1);
+}
 
-    exec_params(oss.str(), std::forward<Args>(values)...);
+uint64_t LatencyHistogram::bucket_max(size_t bucket) {
+    if (bucket < 2 * kSubBuckets) {
+        return bucket;
+    }
+    const size_t width = bucket / kSubBuckets + 3;
+    const size_t sub = bucket % kSubBuckets;
+    const uint64_t low = (kSubBuckets + sub) << (width - 4);
+    return low + (uint64_t(1) << (width - 4)) - 1;
 }
 
-// Close connection
-void Database::close() {
-    if (_conn) {
-        _conn.reset();  // _conn->close();
+void LatencyHistogram::record(std::chrono::nanoseconds value) {
+    const uint64_t nanos = value.count() > 0 ? uint64_t(value.count()) : 0;
+    _counts[bucket_for(nanos)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(nanos, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+    return _count.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds LatencyHistogram::sum() const {
+    return std::chrono::nanoseconds(_sum.load(std::memory_order_relaxed));
+}
+
+// Upper bound of the bucket holding quantile q
+std::chrono::nanoseconds LatencyHistogram::percentile(double q) const {
+    const uint64_t total = count();
+    if (total == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    const auto rank = static_cast<uint64_t>(
+        std::clamp(q, 0.0, 1.0) * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += _counts[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::chrono::nanoseconds(bucket_max(bucket));
+        }
     }
+    return std::chrono::nanoseconds(bucket_max(kBuckets - 1));
 }
 
-ConnectionPool::ConnectionPool(const std::string& connectionString,
-                               size_t maxConnections)
-    : _connectionString(connectionString), _maxConnections(maxConnections) {
-    _pool.reserve(_maxConnections);
+// Append a Prometheus histogram in seconds
+void LatencyHistogram::write_prometheus(std::string& out,
+                                        const std::string& name,
+                                        const std::string& labels) const {
+    const std::string sep = labels.empty() ? "" : ",";
+
+    // A fixed ladder of cumulative buckets: rate() and histogram_quantile()
+    // need the same le series on every scrape. Internal buckets never
+    // straddle a power of two, so each bound is exact.
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (size_t power = kMinExportPower; power <= kMaxExportPower; ++power) {
+        const uint64_t bound = uint64_t(1) << power;
+        for (; bucket < kBuckets && bucket_max(bucket) < bound; ++bucket) {
+            cumulative += _counts[bucket].load(std::memory_order_relaxed);
+        }
+        out += name + "_bucket{" + labels + sep + "le=\"" +
+               format_seconds(bound) + "\"} " + std::to_string(cumulative) +
+               "\n";
+    }
+    for (; bucket < kBuckets; ++bucket) {
+        cumulative += _counts[bucket].load(std::memory_order_relaxed);
+    }
+    out += name + "_bucket{" + labels + sep + "le=\"+Inf\"} " +
+           std::to_string(std::max(cumulative, count())) + "\n";
+    const std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    out += name + "_sum" + braces + " " + format_seconds(sum().count()) +
+           "\n";
+    out += name + "_count" + braces + " " + std::to_string(count()) + "\n";
 }
 
-ConnectionPool::~ConnectionPool() {
+MetricsObserver::MetricsObserver(bool measureBytes)
+    : _measureBytes(measureBytes) {}
+
+void MetricsObserver::on_query(const QueryEvent& event) {
+    _queryLatency.record(event.duration);
+    _queries[size_t(event.status)].fetch_add(1, std::memory_order_relaxed);
+    _rows.fetch_add(event.rows, std::memory_order_relaxed);
+    _bytes.fetch_add(event.bytes, std::memory_order_relaxed);
+}
+
+void MetricsObserver::on_pool(const PoolEvent& event) {
+    if (event.kind == PoolEventKind::Acquired) {
+        _acquireWait.record(event.wait);
+    }
+    _poolEvents[size_t(event.kind)].fetch_add(1, std::memory_order_relaxed);
+    _totalConnections.store(event.totalConnections, std::memory_order_relaxed);
+    _idleConnections.store(event.idleConnections, std::memory_order_relaxed);
+    _waitingThreads.store(event.waitingThreads, std::memory_order_relaxed);
+}
+
+void MetricsObserver::on_cache(const CacheEvent& event) {
+    (event.hit ? _cacheHits : _cacheMisses)
+        .fetch_add(1, std::memory_order_relaxed);
+}
+
+// Text exposition format
+std::string MetricsObserver::prometheus(const std::string& prefix) const {
+    static const char* const statuses[] = {"ok", "sql_error",
+                                           "connection_error", "other_error"};
+    static const char* const poolEvents[] = {"acquired", "timed_out", "opened",
+                                             "retired", "broken"};
+    auto load = [](const std::atomic<uint64_t>& value) {
+        return std::to_string(value.load(std::memory_order_relaxed));
+    };
+
+    std::string out;
+    out += "# TYPE " + prefix + "_query_duration_seconds histogram\n";
+    _queryLatency.write_prometheus(out, prefix + "_query_duration_seconds");
+
+    out += "# TYPE " + prefix + "_queries_total counter\n";
+    for (size_t i = 0; i < _queries.size(); ++i) {
+        out += prefix + "_queries_total{status=\"" + statuses[i] + "\"} " +
+               load(_queries[i]) + "\n";
+    }
+    out += "# TYPE " + prefix + "_rows_total counter\n";
+    out += prefix + "_rows_total " + load(_rows) + "\n";
+    if (_measureBytes) {
+        out += "# TYPE " + prefix + "_bytes_total counter\n";
+        out += prefix + "_bytes_total " + load(_bytes) + "\n";
+    }
+
+    out += "# TYPE " + prefix + "_cache_lookups_total counter\n";
+    out += prefix + "_cache_lookups_total{result=\"hit\"} " +
+           load(_cacheHits) + "\n";
+    out += prefix + "_cache_lookups_total{result=\"miss\"} " +
+           load(_cacheMisses) + "\n";
+
+    out += "# TYPE " + prefix + "_pool_acquire_wait_seconds histogram\n";
+    _acquireWait.write_prometheus(out, prefix + "_pool_acquire_wait_seconds");
+
+    out += "# TYPE " + prefix + "_pool_events_total counter\n";
+    for (size_t i = 0; i < _poolEvents.size(); ++i) {
+        out += prefix + "_pool_events_total{event=\"" + poolEvents[i] +
+               "\"} " + load(_poolEvents[i]) + "\n";
+    }
+
+    const size_t total = _totalConnections.load(std::memory_order_relaxed);
+    const size_t idle = _idleConnections.load(std::memory_order_relaxed);
+    out += "# TYPE " + prefix + "_pool_connections gauge\n";
+    out += prefix + "_pool_connections{state=\"idle\"} " +
+           std::to_string(idle) + "\n";
+    out += prefix + "_pool_connections{state=\"busy\"} " +
+           std::to_string(total > idle ? total - idle : 0) + "\n";
+    out += "# TYPE " + prefix + "_pool_waiting_threads gauge\n";
+    out += prefix + "_pool_waiting_threads " +
+           std::to_string(_waitingThreads.load(std::memory_order_relaxed)) +
+           "\n";
+    return out;
+}
+
+namespace detail {
+
+void QueryTimer::report(const Result* result,
+                        const std::exception* error) const {
+    QueryEvent event{};
+    event.sql = _sql;
+    event.fingerprint = fingerprint_sql(_sql);
+    event.duration = std::chrono::steady_clock::now() - _start;
+    event.status = QueryStatus::Ok;
+
+    if (result) {
+        event.rows =
+            result->columns() > 0 ? result->size() : result->affected_rows();
+        if (_observer->measure_bytes()) {
+            for (const auto& row : *result) {
+                for (int col = 0; col < int(row.size()); ++col) {
+                    event.bytes += row.view(col).size();
+                }
+            }
+        }
+    } else if (auto sqlError = dynamic_cast<const pqxx::sql_error*>(error)) {
+        event.status = QueryStatus::SqlError;
+        event.sqlstate = sqlError->sqlstate();
+    } else if (dynamic_cast<const pqxx::broken_connection*>(error)) {
+        event.status = QueryStatus::ConnectionError;
+    } else {
+        event.status = QueryStatus::OtherError;
+    }
+
+    _observer->on_query(event);
+}
+
+}  // namespace detail
+
+ClusterPool::ClusterPool(const std::string& primary,
+                         const std::vector<std::string>& replicas,
+                         const ClusterOptions& options)
+    : _options(options),
+      _primary(std::make_unique<ConnectionPool>(primary, options.pool)) {
+    _replicas.reserve(replicas.size());
+    for (const auto& replica : replicas) {
+        Replica entry;
+        entry.pool = std::make_unique<ConnectionPool>(replica, options.pool);
+        _replicas.push_back(std::move(entry));
+    }
+}
+
+// Lease a connection for access, waiting up to timeout
+PooledConnection ClusterPool::lease(Access access,
+                                    std::chrono::milliseconds timeout) {
+    if (access == Access::ReadWrite) {
+        return _primary->lease(timeout);
+    }
+    if (auto conn = lease_replica()) {
+        return conn;
+    }
+    if (_options.fallbackToPrimary) {
+        return _primary->lease(timeout);
+    }
+
+    // Every healthy replica is busy: queue on the least busy one
+    const auto candidates = replica_candidates();
+    if (candidates.empty()) {
+        throw ConnectionError("No healthy replica available");
+    }
+    const size_t index = candidates.front();
+    try {
+        auto conn = _replicas[index].pool->lease(timeout);
+        record_success(index);
+        return conn;
+    } catch (const PoolTimeoutError&) {
+        throw;  // Busy, not unhealthy
+    } catch (const DatabaseError&) {
+        record_failure(index);
+        throw;
+    }
+}
+
+// Non-blocking: an empty lease if nothing is available
+PooledConnection ClusterPool::get_connection(Access access) {
+    if (access == Access::ReadOnly) {
+        if (auto conn = lease_replica()) {
+            return conn;
+        }
+        if (!_options.fallbackToPrimary) {
+            return PooledConnection();
+        }
+    }
+    auto conn = _primary->get_connection();
+    return conn ? PooledConnection(_primary.get(), std::move(conn))
+                : PooledConnection();
+}
+
+ClusterStats ClusterPool::stats() const {
+    ClusterStats stats;
+    stats.primary = _primary->stats();
+    const auto now = std::chrono::steady_clock::now();
+    for (const auto& replica : _replicas) {
+        ReplicaStats entry;
+        entry.pool = replica.pool->stats();
+        std::lock_guard lockGuard(_mutex);
+        entry.ejected = replica.ejectedUntil > now;
+        entry.lagging = replica.lagging;
+        entry.lag = replica.lag;
+        stats.replicas.push_back(entry);
+    }
+    return stats;
+}
+
+void ClusterPool::register_prepared(const std::string& name,
+                                    const std::string& sql) {
+    _primary->register_prepared(name, sql);
+    for (auto& replica : _replicas) {
+        replica.pool->register_prepared(name, sql);
+    }
+}
+
+// Eligible replicas, least busy first
+std::vector<size_t> ClusterPool::replica_candidates() const {
+    std::vector<size_t> eligible;
+    {
+        std::lock_guard lockGuard(_mutex);
+        const auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < _replicas.size(); ++i) {
+            const Replica& replica = _replicas[i];
+            // A lagging replica is retried once its next check is due
+            const bool lagKnown =
+                now - replica.lastLagCheck < _options.lagCheckInterval;
+            if (replica.ejectedUntil <= now &&
+                !(replica.lagging && lagKnown)) {
+                eligible.push_back(i);
+            }
+        }
+    }
+
+    // Outstanding work: connections leased out plus threads waiting
+    std::vector<std::pair<size_t, size_t>> load;
+    for (size_t index : eligible) {
+        const PoolStats pool = _replicas[index].pool->stats();
+        load.emplace_back(pool.totalConnections - pool.idleConnections +
+                              pool.waitingThreads,
+                          index);
+    }
+    std::sort(load.begin(), load.end());
+
+    std::vector<size_t> candidates;
+    for (const auto& entry : load) {
+        candidates.push_back(entry.second);
+    }
+    return candidates;
+}
+
+// A connection from the best replica that has one to spare
+PooledConnection ClusterPool::lease_replica() {
+    for (size_t index : replica_candidates()) {
+        ConnectionPool& pool = *_replicas[index].pool;
+        std::unique_ptr<Database> conn;
+        try {
+            conn = pool.get_connection();
+        } catch (const DatabaseError&) {
+            record_failure(index);
+            continue;
+        }
+        if (!conn) {
+            continue;  // Exhausted
+        }
+        if (!check_lag(index, *conn)) {
+            pool.return_connection(std::move(conn));
+            continue;
+        }
+        record_success(index);
+        return PooledConnection(&pool, std::move(conn));
+    }
+    return PooledConnection();
+}
+
+// Measure lag on conn if it is due
+bool ClusterPool::check_lag(size_t index, Database& conn) {
+    if (_options.maxReplicationLag.count() == 0) {
+        return true;
+    }
+    Replica& replica = _replicas[index];
+    {
+        std::lock_guard lockGuard(_mutex);
+        const auto now = std::chrono::steady_clock::now();
+        if (now - replica.lastLagCheck < _options.lagCheckInterval) {
+            return !replica.lagging;
+        }
+        replica.lastLagCheck = now;  // Claim this check
+    }
+
+    std::optional<double> seconds;
+    try {
+        // Zero when replay has caught up, so an idle primary doesn't make
+        // the replica look stale; NULL when not in recovery
+        auto result = conn.exec(
+            "SELECT CASE WHEN pg_last_wal_receive_lsn() = "
+            "pg_last_wal_replay_lsn() THEN 0 ELSE EXTRACT(EPOCH FROM now() - "
+            "pg_last_xact_replay_timestamp()) END");
+        seconds = result.front().get_optional<double>(0);
+    } catch (const DatabaseError&) {
+        record_failure(index);
+        return false;
+    }
+
+    const auto lag = std::chrono::milliseconds(
+        static_cast<int64_t>(seconds.value_or(0) * 1000));
     std::lock_guard lockGuard(_mutex);
-    _pool.clear();  // ensures cleanup
+    replica.lag = lag;
+    replica.lagging = lag > _options.maxReplicationLag;
+    return !replica.lagging;
 }
 
-std::unique_ptr<Database> ConnectionPool::get_connection() {
+void ClusterPool::record_failure(size_t index) {
     std::lock_guard lockGuard(_mutex);
+    Replica& replica = _replicas[index];
+    if (++replica.failures >= _options.maxFailures) {
+        replica.ejectedUntil =
+            std::chrono::steady_clock::now() + _options.ejectionTime;
+        replica.failures = 0;
+    }
+}
 
-    // If there's an available one in the pool, return it
-    if (!_pool.empty()) {
-        auto conn = std::move(_pool.back());
-        _pool.pop_back();
-        return conn;
+void ClusterPool::record_success(size_t index) {
+    std::lock_guard lockGuard(_mutex);
+    _replicas[index].failures = 0;
+}
+
+// Buffers one channel's notifications for the event thread
+class Subscriber::Receiver : public pqxx::notification_receiver {
+   public:
+    Receiver(pqxx::connection& conn, const std::string& channel,
+             std::vector<Notification>& received)
+        : pqxx::notification_receiver(conn, channel), _received(received) {}
+
+    void operator()(const std::string& payload, int backendPid) override {
+        _received.push_back(Notification{channel(), payload, backendPid});
     }
 
-    // If we haven't reached the max, create a new one
-    if (_currentConnections < _maxConnections) {
-        ++_currentConnections;
-        return std::make_unique<Database>(_connectionString);
+   private:
+    std::vector<Notification>& _received;
+};
+
+Subscriber::Subscriber(const std::string& connectionString,
+                       const SubscriberOptions& options)
+    : _connectionString(connectionString), _options(options) {
+    _worker = std::thread(&Subscriber::run, this);
+}
+
+Subscriber::~Subscriber() {
+    {
+        std::lock_guard lockGuard(_mutex);
+        _stopping = true;
     }
+    _workerCv.notify_all();
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
 
-    // Pool exhausted
-    return nullptr;
+// Call callback for notifications on channel
+void Subscriber::listen(const std::string& channel, Callback callback) {
+    std::lock_guard lockGuard(_mutex);
+    _callbacks[channel].push_back(std::move(callback));
 }
 
-void ConnectionPool::return_connection(std::unique_ptr<Database> conn) {
-    if (!conn || !conn->is_open()) {
-        // Drop broken connection
+bool Subscriber::connected() const {
+    return _connected.load(std::memory_order_acquire);
+}
+
+// Event thread: (re)connect, LISTEN, wait, dispatch
+void Subscriber::run() {
+    auto backoff = _options.reconnectBackoff;
+    bool reconnecting = false;
+
+    while (true) {
+        {
+            std::lock_guard lockGuard(_mutex);
+            if (_stopping) {
+                break;
+            }
+        }
+
+        try {
+            if (!_conn) {
+                open();
+                backoff = _options.reconnectBackoff;
+            }
+            listen_new_channels();
+            if (reconnecting) {
+                reconnecting = false;
+                dispatch_reconnected();
+            }
+
+            wait_for_batch();
+            if (!_received.empty()) {
+                std::vector<Notification> batch;
+                batch.swap(_received);
+                dispatch(batch);
+            }
+        } catch (const std::exception&) {
+            // Lost or refused connection: LISTEN again once it is back
+            close();
+            reconnecting = true;
+
+            std::unique_lock lock(_mutex);
+            _workerCv.wait_for(lock, backoff, [this] { return _stopping; });
+            backoff = std::min(backoff * 2, _options.maxReconnectBackoff);
+        }
+    }
+    close();
+}
+
+void Subscriber::open() {
+    _conn = std::make_unique<pqxx::connection>(_connectionString);
+    _connected.store(true, std::memory_order_release);
+}
+
+void Subscriber::close() {
+    _connected.store(false, std::memory_order_release);
+    _receivers.clear();  // Before the connection they belong to
+    _listening.clear();
+    _received.clear();
+    _conn.reset();
+}
+
+// LISTEN on channels registered since the last pass
+void Subscriber::listen_new_channels() {
+    std::vector<std::string> channels;
+    {
         std::lock_guard lockGuard(_mutex);
-        --_currentConnections;
+        for (const auto& entry : _callbacks) {
+            if (_listening.count(entry.first) == 0) {
+                channels.push_back(entry.first);
+            }
+        }
+    }
+    for (const auto& channel : channels) {
+        _receivers.push_back(
+            std::make_unique<Receiver>(*_conn, channel, _received));
+        _listening.insert(channel);
+    }
+}
+
+// Wait up to pollInterval for a notification, then collect the rest of
+// its burst for batchWindow
+void Subscriber::wait_for_batch() {
+    auto await = [this](std::chrono::microseconds timeout) {
+        const auto seconds =
+            std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        return _conn->await_notification(
+            seconds.count(), long((timeout - seconds).count()));
+    };
+
+    if (await(_options.pollInterval) == 0) {
         return;
     }
+    const auto deadline =
+        std::chrono::steady_clock::now() + _options.batchWindow;
+    for (auto now = std::chrono::steady_clock::now(); now < deadline;
+         now = std::chrono::steady_clock::now()) {
+        await(std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - now));
+    }
+}
 
-    std::lock_guard lockGuard(_mutex);
-    if (_pool.size() < _maxConnections) {
-        _pool.push_back(std::move(conn));
-    } else {
-        // Pool full — destroy the extra connection
-        --_currentConnections;
+// Hand each channel's notifications to its callbacks
+void Subscriber::dispatch(std::vector<Notification>& batch) {
+    std::unordered_map<std::string, std::vector<Notification>> byChannel;
+    for (auto& notification : batch) {
+        byChannel[notification.channel].push_back(std::move(notification));
+    }
+
+    for (const auto& [channel, notifications] : byChannel) {
+        std::vector<Callback> callbacks;
+        {
+            std::lock_guard lockGuard(_mutex);
+            auto itr = _callbacks.find(channel);
+            if (itr != _callbacks.end()) {
+                callbacks = itr->second;
+            }
+        }
+        for (const auto& callback : callbacks) {
+            try {
+                callback(notifications);
+            } catch (...) {
+                // A failing callback must not stop the event thread
+            }
+        }
+    }
+}
+
+// Tell every callback that notifications may have been missed
+void Subscriber::dispatch_reconnected() {
+    std::vector<Callback> callbacks;
+    {
+        std::lock_guard lockGuard(_mutex);
+        for (const auto& entry : _callbacks) {
+            callbacks.insert(callbacks.end(), entry.second.begin(),
+                             entry.second.end());
+        }
+    }
+    const std::vector<Notification> none;
+    for (const auto& callback : callbacks) {
+        try {
+            callback(none);
+        } catch (...) {
+            // As in dispatch()
+        }
+    }
+}
+
+AsyncConnection::AsyncConnection(const std::string& connectionString)
+    : _ownedDb(std::make_unique<Database>(connectionString)),
+      _db(_ownedDb.get()),
+      _pipeline(_db->pipeline()) {
+    _pipeline.retain(0);  // Send each query as soon as it is queued
+}
+
+namespace {
+
+// The leased connection; an empty or moved-from lease has none
+Database* leased_database(const PooledConnection& lease) {
+    if (!lease) {
+        throw std::invalid_argument("AsyncConnection needs a non-empty lease");
+    }
+    return lease.get();
+}
+
+}  // namespace
+
+AsyncConnection::AsyncConnection(PooledConnection lease)
+    : _lease(std::move(lease)),
+      _db(leased_database(_lease)),
+      _pipeline(_db->pipeline()) {
+    _pipeline.retain(0);
+}
+
+AsyncConnection::~AsyncConnection() {
+    try {
+        wait();
+    } catch (...) {
+        // Ignore exceptions in destructor
+    }
+}
+
+// Queue a query
+std::future<Result> AsyncConnection::async_exec(const std::string& sql) {
+    return enqueue(_pipeline.exec(sql));
+}
+
+int AsyncConnection::socket() const { return _db->socket(); }
+
+// Complete every query whose result has arrived, without blocking
+size_t AsyncConnection::poll() {
+    _pipeline.poll();
+    size_t completed = 0;
+    // Results arrive in submission order
+    while (!_pending.empty() && _pipeline.ready(_pending.front().handle)) {
+        complete_front();
+        ++completed;
+    }
+    return completed;
+}
+
+// Block until every queued query has completed
+void AsyncConnection::wait() {
+    while (!_pending.empty()) {
+        complete_front();
+    }
+}
+
+size_t AsyncConnection::pending() const { return _pending.size(); }
+
+std::future<Result> AsyncConnection::enqueue(QueryHandle handle) {
+    _pending.push_back(Pending{handle, std::promise<Result>()});
+    auto future = _pending.back().promise.get_future();
+    _pipeline.poll();  // Flush it to the server
+    return future;
+}
+
+// Fulfil the oldest pending query's future
+void AsyncConnection::complete_front() {
+    Pending pending = std::move(_pending.front());
+    _pending.pop_front();
+    try {
+        pending.promise.set_value(_pipeline.take(pending.handle));
+    } catch (...) {
+        pending.promise.set_exception(std::current_exception());
     }
 }
 
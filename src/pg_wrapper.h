@@ -1,6 +1,22 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <chrono>
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -8,9 +24,59 @@
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+// Apache Arrow C Data Interface, as specified at
+// https://arrow.apache.org/docs/format/CDataInterface.html
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    // Array type description
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+struct ArrowArray {
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray*);
+    // Opaque producer-specific data
+    void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
 namespace pg_wrapper {
 
 // Exception classes
@@ -26,20 +92,296 @@ class ConnectionError : public DatabaseError {
 
 class QueryError : public DatabaseError {
    public:
-    explicit QueryError(const std::string& msg);
+    explicit QueryError(const std::string& msg, std::string sqlstate = {});
+
+    // Five-character SQLSTATE reported by the server, empty if unknown
+    const std::string& sqlstate() const { return _sqlstate; }
+
+   private:
+    std::string _sqlstate;
+};
+
+// SQLSTATE class 40: the server rolled the transaction back, and running
+// the whole transaction again may succeed
+class TransactionRollbackError : public QueryError {
+   public:
+    TransactionRollbackError(const std::string& msg, std::string sqlstate);
+};
+
+// 40001: could not serialize access due to concurrent update
+class SerializationError : public TransactionRollbackError {
+   public:
+    SerializationError(const std::string& msg, std::string sqlstate);
+};
+
+// 40P01: chosen as the victim of a deadlock
+class DeadlockError : public TransactionRollbackError {
+   public:
+    DeadlockError(const std::string& msg, std::string sqlstate);
+};
+
+// SQLSTATE class 23: unique, foreign key, check or NOT NULL violation
+class ConstraintError : public QueryError {
+   public:
+    ConstraintError(const std::string& msg, std::string sqlstate);
+};
+
+class PoolTimeoutError : public ConnectionError {
+   public:
+    explicit PoolTimeoutError(const std::string& msg);
+};
+
+// The connection dropped while a statement was running; whether that
+// statement took effect is unknown
+class ConnectionLostError : public ConnectionError {
+   public:
+    explicit ConnectionLostError(const std::string& msg);
+};
+
+namespace detail {
+
+// Throw e as the QueryError subclass matching its SQLSTATE
+[[noreturn]] void throw_query_error(const pqxx::sql_error& e);
+
+// Throw any other failure as ConnectionLostError or DatabaseError
+[[noreturn]] void throw_database_error(const std::exception& e);
+
+}  // namespace detail
+
+// Binds a struct member to a result column by name
+template <typename T, typename M>
+struct ColumnBinding {
+    const char* name;
+    M T::*member;
+};
+
+template <typename T, typename M>
+constexpr ColumnBinding<T, M> column(const char* name, M T::*member) {
+    return {name, member};
+}
+
+// Specialize to let Result::as<T>() fill a struct, e.g.
+//
+//   template <>
+//   struct pg_wrapper::RowMapping<User> {
+//       static constexpr auto columns =
+//           std::make_tuple(pg_wrapper::column("id", &User::id),
+//                           pg_wrapper::column("name", &User::name));
+//   };
+//
+// std::optional members receive NULLs; other members throw on NULL.
+template <typename T>
+struct RowMapping;
+
+namespace detail {
+
+template <typename T>
+struct is_tuple : std::false_type {};
+
+template <typename... Types>
+struct is_tuple<std::tuple<Types...>> : std::true_type {};
+
+template <typename T>
+struct is_optional : std::false_type {};
+
+template <typename T>
+struct is_optional<std::optional<T>> : std::true_type {};
+
+// Parse timestamp/timestamptz/date output in the ISO DateStyle; NULL if the
+// text isn't in that form
+std::optional<std::chrono::system_clock::time_point> parse_timestamp(
+    std::string_view text);
+
+// Decode bytea hex-format output; false if the text is in escape format
+bool decode_bytea_hex(std::string_view text, std::vector<std::byte>& out);
+
+// Decoders that read PostgreSQL's output for the common column types
+// directly with std::from_chars and friends, instead of going through
+// pqxx's generic string conversions. Anything unexpected, including NULL,
+// falls back to pqxx, so results and errors match field.as<T>().
+template <typename T, typename = void>
+struct FieldDecoder {
+    static T decode(const pqxx::field& field) { return field.as<T>(); }
+};
+
+// int2, int4, int8, oid
+template <typename T>
+struct FieldDecoder<T, std::enable_if_t<std::is_integral_v<T> &&
+                                        !std::is_same_v<T, bool>>> {
+    static T decode(const pqxx::field& field) {
+        const char* begin = field.c_str();
+        const char* end = begin + field.size();
+        T value{};
+        auto [ptr, ec] = std::from_chars(begin, end, value);
+        if (ec != std::errc() || ptr != end || field.is_null()) {
+            return field.as<T>();
+        }
+        return value;
+    }
+};
+
+// float4, float8, and numeric read as a floating point value
+template <typename T>
+struct FieldDecoder<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+    static T decode(const pqxx::field& field) {
+        const char* begin = field.c_str();
+        const char* end = begin + field.size();
+        T value{};
+        auto [ptr, ec] = std::from_chars(begin, end, value);
+        if (ec != std::errc() || ptr != end || field.is_null()) {
+            return field.as<T>();
+        }
+        return value;
+    }
+};
+
+// bool ("t"/"f")
+template <>
+struct FieldDecoder<bool> {
+    static bool decode(const pqxx::field& field) {
+        if (field.size() == 1 && !field.is_null()) {
+            const char ch = field.c_str()[0];
+            if (ch == 't') return true;
+            if (ch == 'f') return false;
+        }
+        return field.as<bool>();
+    }
+};
+
+// Text as an owning copy, or as a view into the result buffer that is valid
+// while the Result is alive
+template <typename T>
+struct FieldDecoder<T, std::enable_if_t<std::is_same_v<T, std::string> ||
+                                        std::is_same_v<T, std::string_view>>> {
+    static T decode(const pqxx::field& field) {
+        if (field.is_null()) {
+            if constexpr (std::is_same_v<T, std::string_view>) {
+                throw pqxx::conversion_error("Attempt to read NULL as text");
+            } else {
+                return field.as<T>();
+            }
+        }
+        return T(field.c_str(), field.size());
+    }
+};
+
+// timestamp, timestamptz and date, as UTC with microsecond precision
+template <>
+struct FieldDecoder<std::chrono::system_clock::time_point> {
+    static std::chrono::system_clock::time_point decode(
+        const pqxx::field& field) {
+        if (field.is_null()) {
+            throw pqxx::conversion_error("Attempt to read NULL timestamp");
+        }
+        if (auto tp = parse_timestamp(std::string_view(field.c_str(),
+                                                       field.size()))) {
+            return *tp;
+        }
+        throw pqxx::conversion_error("Unsupported timestamp format: " +
+                                     std::string(field.c_str()));
+    }
+};
+
+// bytea
+template <>
+struct FieldDecoder<std::vector<std::byte>> {
+    static std::vector<std::byte> decode(const pqxx::field& field) {
+        std::vector<std::byte> bytes;
+        if (!field.is_null() &&
+            decode_bytea_hex(std::string_view(field.c_str(), field.size()),
+                             bytes)) {
+            return bytes;
+        }
+        // Escape format, or NULL: let pqxx decode or report it
+        const auto raw = field.as<std::basic_string<std::byte>>();
+        return std::vector<std::byte>(raw.begin(), raw.end());
+    }
+};
+
+// Convert a field, mapping NULL to nullopt for std::optional targets
+template <typename T>
+T decode_field(const pqxx::field& field) {
+    if constexpr (is_optional<T>::value) {
+        return field.is_null()
+                   ? std::nullopt
+                   : T(FieldDecoder<typename T::value_type>::decode(field));
+    } else {
+        return FieldDecoder<T>::decode(field);
+    }
+}
+
+// Column name -> index map shared by a Result and its Rows, built on the
+// first lookup by name
+class ColumnIndex {
+   public:
+    explicit ColumnIndex(const pqxx::result& result);
+
+    // Index of the named column, resolved like PQfnumber() (unquoted names
+    // fold to lower case); throws like pqxx if there is none
+    int find(const std::string& name) const;
+
+   private:
+    pqxx::result _result;
+    mutable std::once_flag _built;
+    mutable std::unordered_map<std::string, int> _columns;
+};
+
+}  // namespace detail
+
+// A column position resolved once with Result::column(), for index-speed
+// access by name in a loop
+struct ColumnRef {
+    int index;
+};
+
+// Non-owning view of a bytea field in hex output format ("\x" followed by
+// two hex digits per byte). Bytes are decoded on access, so nothing is
+// allocated; the view is valid as long as the Result it came from.
+class ByteView {
+   public:
+    ByteView() = default;
+
+    // Throws pqxx::conversion_error unless text is hex-format bytea
+    explicit ByteView(std::string_view text);
+
+    size_t size() const;
+    bool empty() const;
+
+    std::byte operator[](size_t i) const;
+
+    // The hex digits, without the "\x" prefix
+    std::string_view hex() const;
+
+    // Decode into out, which must have room for size() bytes
+    void copy_to(std::byte* out) const;
+
+    std::vector<std::byte> to_vector() const;
+
+   private:
+    std::string_view _hex;
 };
 
 // Forward declarations
 class Row;
 class Result;
+class RowRef;
+class ColumnarResult;
 class Transaction;
+class Pipeline;
+class Inserter;
+template <typename... Types>
+class StreamingResult;
 class Database;
+class ConnectionPool;
+class Subscriber;
 
-// Row class - represents a single row from query results
-class Row {
-   public:
-    explicit Row(const pqxx::row& row);
+namespace detail {
 
+// Field accessors shared by Row and RowRef. Derived supplies field(col),
+// field_count() and column_index(name).
+template <typename Derived>
+class RowAccessors {
+   public:
     // Get value by column index
     template <typename T>
     T get(int col) const;
@@ -55,32 +397,174 @@ class Row {
     template <typename T>
     std::optional<T> get_optional(const std::string& colName) const;
 
+    // Access by a column resolved with Result::column()
+    template <typename T>
+    T get(ColumnRef col) const;
+
+    template <typename T>
+    std::optional<T> get_optional(ColumnRef col) const;
+
     // Check if column is NULL
     bool is_null(int col) const;
 
     bool is_null(const std::string& colName) const;
 
+    bool is_null(ColumnRef col) const;
+
+    // Text of a field without copying, pointing into the result buffer and
+    // valid as long as the Result. NULL reads as empty; check is_null().
+    std::string_view view(int col) const;
+
+    std::string_view view(const std::string& colName) const;
+
+    std::string_view view(ColumnRef col) const;
+
+    // bytea field without decoding or copying; empty for NULL
+    ByteView bytes(int col) const;
+
+    ByteView bytes(const std::string& colName) const;
+
+    ByteView bytes(ColumnRef col) const;
+
     // Get number of columns
     size_t size() const;
 
     // // Column name access
     // std::string column_name(size_t col) const;
 
+   protected:
+    RowAccessors() = default;
+
+   private:
+    const Derived& self() const { return static_cast<const Derived&>(*this); }
+};
+
+}  // namespace detail
+
+// Non-owning reference to a row of a Result: a result pointer and a row
+// number, so creating and copying one touches no reference counts. Valid
+// while the Result it came from is alive and not moved from; convert to
+// Row to keep a row beyond that.
+class RowRef : public detail::RowAccessors<RowRef> {
+   public:
+    // owner, if given, resolves column names through its shared index
+    RowRef(const pqxx::result* result, int row, const Result* owner = nullptr);
+
+    // Position of this row within its Result
+    size_t row_number() const;
+
+   private:
+    friend class detail::RowAccessors<RowRef>;
+    friend class Row;
+
+    pqxx::field field(int col) const { return _result->at(_row, col); }
+    int field_count() const { return _result->columns(); }
+    int column_index(const std::string& colName) const;
+
+    const pqxx::result* _result;
+    int _row;
+    const Result* _owner;
+};
+
+// Row class - represents a single row from query results. Shares ownership
+// of the result data, so it stays valid after its Result is gone.
+class Row : public detail::RowAccessors<Row> {
+   public:
+    explicit Row(const pqxx::row& row);
+
+    // Row whose by-name lookups go through its Result's column index
+    Row(const pqxx::row& row,
+        std::shared_ptr<const detail::ColumnIndex> columns);
+
+    // Owning copy of a row reference
+    Row(const RowRef& ref);
+
    private:
+    friend class detail::RowAccessors<Row>;
+
+    pqxx::field field(int col) const { return _row[col]; }
+    int field_count() const { return _row.size(); }
+
+    // Index of the named column, through the shared map when available
+    int column_index(const std::string& colName) const;
+
     pqxx::row _row;
+    std::shared_ptr<const detail::ColumnIndex> _columns;
+};
+
+// The non-template accessors are compiled once, in the library
+namespace detail {
+extern template class RowAccessors<Row>;
+extern template class RowAccessors<RowRef>;
+}  // namespace detail
+
+// Zero-copy views of one column's fields, in row order
+class ColumnViews {
+   public:
+    class iterator {
+       public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view*;
+        using reference = std::string_view;
+
+        iterator() = default;
+        iterator(pqxx::result::const_iterator itr, int col);
+
+        std::string_view operator*() const;
+
+        // Whether the current field is NULL
+        bool is_null() const;
+
+        bool operator==(const iterator& itr) const;
+        bool operator!=(const iterator& itr) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+
+       private:
+        pqxx::result::const_iterator _itr;
+        int _col = 0;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    size_t size() const;
+
+   private:
+    friend class Result;
+
+    ColumnViews(const pqxx::result& result, int col);
+
+    pqxx::result _result;
+    int _col;
 };
 
 // Result class - represents query results
 class Result {
    public:
-    explicit Result(const pqxx::result& result);
+    explicit Result(pqxx::result result);
 
-    // Iterator support
+    Result(const Result& other);
+    Result(Result&& other) noexcept = default;
+    Result& operator=(const Result& other);
+    Result& operator=(Result&& other) noexcept = default;
+
+    // Iterator support; rows are yielded as lightweight RowRefs. Those are
+    // values, not references, so this is only an input iterator.
     class iterator {
        public:
-        explicit iterator(pqxx::result::const_iterator itr);
+        using iterator_category = std::input_iterator_tag;
+        using value_type = RowRef;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = RowRef;
+
+        iterator(const pqxx::result* result, int row,
+                 const Result* owner = nullptr);
 
-        Row operator*() const;
+        RowRef operator*() const;
 
         bool operator==(const iterator& itr) const;
         bool operator!=(const iterator& itr) const;
@@ -89,22 +573,30 @@ class Result {
         iterator operator++(int);
 
        private:
-        pqxx::result::const_iterator _itr;
+        const pqxx::result* _result;
+        int _row;
+        const Result* _owner;
     };
 
     iterator begin() const;
     iterator end() const;
 
-    // Access rows
-    Row operator[](size_t rowNum) const;
+    // Access rows. A Result variable hands out RowRefs; a temporary one
+    // hands out owning Rows, so `auto row = db.exec(sql).front();` doesn't
+    // dangle.
+    RowRef operator[](size_t rowNum) const&;
+    Row operator[](size_t rowNum) &&;
 
-    Row at(size_t rowNum) const;
+    RowRef at(size_t rowNum) const&;
+    Row at(size_t rowNum) &&;
 
     // Get first row (throws if empty)
-    Row front() const;
+    RowRef front() const&;
+    Row front() &&;
 
     // Get first row as optional
-    std::optional<Row> front_optional() const;
+    std::optional<RowRef> front_optional() const&;
+    std::optional<Row> front_optional() &&;
 
     // Result properties
     size_t size() const;
@@ -115,123 +607,2432 @@ class Result {
     // Column information
     std::string column_name(size_t col) const;
 
-    // Convert all rows to vector
+    // Resolve a column name once, for fast by-name access in row loops
+    ColumnRef column(const std::string& name) const;
+
+    // Iterate one column as string_views into the result buffer
+    ColumnViews column_views(int col) const;
+    ColumnViews column_views(const std::string& name) const;
+    ColumnViews column_views(ColumnRef col) const;
+
+    // Convert all rows to vector. converter is called with each RowRef
+    // (or a Row converted from it, if that is what it takes).
+    template <typename T, typename Converter>
+    std::vector<T> to_vector(Converter&& converter) const;
+
+    // Convert all rows to a std::tuple by column position, or to a struct
+    // described by RowMapping<T>. Column names are resolved once per call
+    // and each row is decoded without any per-row lookup or indirect call.
     template <typename T>
-    std::vector<T> to_vector(std::function<T(const Row&)> converter) const;
+    std::vector<T> as() const;
+
+    // Decode the whole result column by column into contiguous typed
+    // buffers with Arrow-style validity bitmaps
+    ColumnarResult to_columns() const;
 
    private:
+    friend class RowRef;
+    friend class Row;
+
+    // The shared column index, created on the first lookup by name
+    const detail::ColumnIndex& column_index() const;
+
     pqxx::result _result;
+    // Null until column_index() is first called, so results only read by
+    // position never allocate one. Results can be shared across threads
+    // (QueryCache), so it is only accessed with std::atomic_load/_store.
+    mutable std::shared_ptr<const detail::ColumnIndex> _columns;
 };
 
-// Transaction class
-class Transaction {
+// Physical type of a decoded column. Types without a fixed-width mapping
+// (numeric, text, json, arrays, ...) are kept as their text output.
+enum class ColumnType {
+    Boolean,      // bool, bit-packed
+    Int16,        // int2
+    Int32,        // int4
+    Int64,        // int8
+    Float32,      // float4
+    Float64,      // float8
+    Date32,       // date, days since 1970-01-01
+    Timestamp,    // timestamp, microseconds since 1970-01-01
+    TimestampTz,  // timestamptz, microseconds since 1970-01-01 UTC
+    Utf8          // everything else, as text
+};
+
+// One column of a ColumnarResult, laid out like an Arrow array: a validity
+// bitmap (bit set = not NULL, least significant bit first), a value buffer,
+// and for Utf8 an offsets buffer of size() + 1 entries
+class Column {
    public:
-    explicit Transaction(pqxx::connection& conn);
+    const std::string& name() const;
+    ColumnType type() const;
+    size_t size() const;
+    size_t null_count() const;
 
-    ~Transaction();
+    bool is_null(size_t row) const;
 
-    // Execute query
-    Result exec(const std::string& sql);
+    // Validity bitmap, or nullptr when the column has no NULLs
+    const uint8_t* validity() const;
 
-    // Execute parameterized query
-    template <typename... Args>
-    Result exec_params(const std::string& sql, Args&&... args);
+    // Fixed-width values; T must match type(): int16_t, int32_t (Int32 and
+    // Date32), int64_t (Int64 and timestamps), float or double. NULL slots
+    // hold zero.
+    template <typename T>
+    const T* values() const;
 
-    // Execute prepared statement
-    template <typename... Args>
-    Result exec_prepared(const std::string& name, Args&&... args);
+    bool boolean(size_t row) const;
 
-    // Commit transaction
-    void commit();
+    // Utf8 access
+    const int32_t* offsets() const;
+    std::string_view text(size_t row) const;
 
-    // Abort transaction
-    void abort();
+   private:
+    friend class Result;
+    friend class ColumnarResult;
 
-    // Quote and escape values
-    std::string quote(const std::string& value);
+    void decode(const pqxx::result& result, int col);
 
-    std::string quote_name(const std::string& name);
+    template <typename T, typename Decode>
+    void decode_values(const pqxx::result& result, int col, Decode decode);
 
-   private:
-    std::unique_ptr<pqxx::work> _txn;
-    bool _committed;
+    void decode_text(const pqxx::result& result, int col);
+
+    std::string _name;
+    ColumnType _type = ColumnType::Utf8;
+    size_t _size = 0;
+    size_t _nullCount = 0;
+    std::vector<uint8_t> _validity;
+    std::vector<std::byte> _data;
+    std::vector<int32_t> _offsets;
 };
 
-// Database connection class
-class Database {
+// Column-major copy of a Result, for vectorized consumers
+class ColumnarResult {
    public:
-    // Constructor with connection string
-    explicit Database(const std::string& connectionString);
+    size_t rows() const;
+    size_t columns() const;
 
-    // Constructor with individual parameters
-    Database(const std::string& host, const std::string& port,
-             const std::string& dbname, const std::string& user,
-             const std::string& password);
+    const Column& operator[](size_t col) const;
+    const Column& column(const std::string& name) const;
 
-    // Check if connected
-    bool is_open() const { return _conn && _conn->is_open(); }
+    // Export as an Arrow struct array with one child per column. The
+    // buffers are shared, not copied, and stay valid until both release
+    // callbacks have run, even if this object is destroyed first.
+    void export_arrow(ArrowArray* array, ArrowSchema* schema) const;
 
-    // Get connection info
-    std::string dbname() const { return _conn->dbname(); }
-    std::string username() const { return _conn->username(); }
-    std::string hostname() const { return _conn->hostname(); }
-    std::string port() const { return _conn->port(); }
+   private:
+    friend class Result;
 
-    // Create transaction
-    Transaction begin_transaction();
+    size_t _rows = 0;
+    std::shared_ptr<std::vector<Column>> _columns;
+};
 
-    // Execute query without transaction (auto-commit)
-    Result exec(const std::string& sql);
+// How a statement ended, for observers
+enum class QueryStatus {
+    Ok,
+    SqlError,         // Rejected by the server; see QueryEvent::sqlstate
+    ConnectionError,  // Connection lost
+    OtherError,
+};
 
-    // Execute parameterized query without transaction
-    template <typename... Args>
-    Result exec_params(const std::string& sql, Args&&... args);
+// One statement run through a Transaction or Database
+struct QueryEvent {
+    std::string_view sql;  // SQL text, or the name for exec_prepared()
+    uint64_t fingerprint;  // fingerprint_sql(sql)
+    std::chrono::nanoseconds duration;
+    size_t rows;   // Rows returned, or affected by a command
+    size_t bytes;  // Field bytes returned; 0 unless measure_bytes()
+    QueryStatus status;
+    std::string_view sqlstate;  // For SqlError
+};
 
-    // Prepare statement
-    void prepare(const std::string& name, const std::string& sql);
+enum class PoolEventKind {
+    Acquired,  // From the idle list or a new slot; wait is the time blocked
+    TimedOut,  // acquire() gave up after wait
+    Opened,    // New connection established
+    Retired,   // Closed for age or idleness
+    Broken,    // Returned closed; reopened in the background
+};
 
-    // Execute prepared statement without transaction
-    template <typename... Args>
-    Result exec_prepared(const std::string& name, Args&&... args);
+struct PoolEvent {
+    PoolEventKind kind;
+    std::chrono::nanoseconds wait{0};
+    size_t totalConnections{0};
+    size_t idleConnections{0};
+    size_t waitingThreads{0};
+};
 
-    // Utility methods for common operations
+// Database::exec_cached() lookup in a QueryCache
+struct CacheEvent {
+    std::string_view sql;
+    uint64_t fingerprint{0};  // fingerprint_sql(sql)
+    bool hit{false};
+};
 
-    // Check if table exists
-    bool table_exists(const std::string& tableName);
+// Receives timing events. Install with Database::set_observer() or
+// PoolOptions::observer; with none installed, instrumentation costs a null
+// check per statement.
+class Observer {
+   public:
+    virtual ~Observer() = default;
 
-    // Get table column names
-    std::vector<std::string> get_columns(const std::string& tableName);
+    // Called on the thread that ran the statement, after it finished
+    virtual void on_query(const QueryEvent&) {}
 
-    // Simple insert helper
-    template <typename... Args>
-    void insert(const std::string& table,
-                const std::vector<std::string>& columns, Args&&... values);
+    // Called with the pool's lock held: keep it short and don't call back
+    // into the pool. Acquisitions served lock-free from a ThreadAffinity
+    // slot are counted in PoolStats but not reported here.
+    virtual void on_pool(const PoolEvent&) {}
 
-    // Close connection
-    void close();
+    // Called on the thread that looked up the cache; a miss is followed by
+    // the query's own on_query()
+    virtual void on_cache(const CacheEvent&) {}
+
+    // Whether QueryEvent::bytes should be measured, which walks every
+    // returned field
+    virtual bool measure_bytes() const { return false; }
+};
+
+// Hash of sql with literals replaced and whitespace and case normalized,
+// so statements differing only in constants share a fingerprint
+uint64_t fingerprint_sql(std::string_view sql);
+
+// Lock-free log-linear (HDR-style) histogram of durations in nanoseconds.
+// Each power of two is split into 8 buckets, so a value's bucket bound is
+// within 12.5% of it. Recording is a few relaxed atomic increments.
+class LatencyHistogram {
+   public:
+    static constexpr size_t kSubBuckets = 8;
+    static constexpr size_t kBuckets = 62 * kSubBuckets;
+
+    void record(std::chrono::nanoseconds value);
+
+    uint64_t count() const;
+    std::chrono::nanoseconds sum() const;
+
+    // Upper bound of the bucket holding quantile q (0..1)
+    std::chrono::nanoseconds percentile(double q) const;
+
+    // Append a Prometheus histogram in seconds, with the same buckets on
+    // every scrape: powers of two from about 1us to 69s. labels is empty or
+    // a list like `kind="query"`.
+    void write_prometheus(std::string& out, const std::string& name,
+                          const std::string& labels = "") const;
 
    private:
-    std::unique_ptr<pqxx::connection> _conn;
+    // Exported le bounds are 2^kMinExportPower .. 2^kMaxExportPower ns
+    static constexpr size_t kMinExportPower = 10;
+    static constexpr size_t kMaxExportPower = 36;
+
+    static size_t bucket_for(uint64_t value);
+    static uint64_t bucket_max(size_t bucket);
+
+    std::array<std::atomic<uint64_t>, kBuckets> _counts{};
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _sum{0};
 };
 
-// Connection pool class for multi-threaded applications
-class ConnectionPool {
+// Observer that aggregates events into counters and histograms for a
+// Prometheus scrape endpoint
+class MetricsObserver : public Observer {
    public:
-    explicit ConnectionPool(const std::string& connectionString,
-                            size_t maxConnections = 10);
+    explicit MetricsObserver(bool measureBytes = false);
 
-    ~ConnectionPool();
+    void on_query(const QueryEvent& event) override;
+    void on_pool(const PoolEvent& event) override;
+    void on_cache(const CacheEvent& event) override;
+    bool measure_bytes() const override { return _measureBytes; }
 
-    std::unique_ptr<Database> get_connection();
+    const LatencyHistogram& query_latency() const { return _queryLatency; }
+    const LatencyHistogram& acquire_wait() const { return _acquireWait; }
 
-    void return_connection(std::unique_ptr<Database> conn);
+    // Text exposition format, metric names starting with prefix
+    std::string prometheus(const std::string& prefix = "pgwrapper") const;
 
    private:
-    std::string _connectionString;
-    std::vector<std::unique_ptr<Database>> _pool;
-    std::mutex _mutex;
-    size_t _maxConnections;
-    size_t _currentConnections{0};  // Tracks live connections
+    bool _measureBytes;
+    LatencyHistogram _queryLatency;
+    LatencyHistogram _acquireWait;
+    std::array<std::atomic<uint64_t>, 4> _queries{};  // By QueryStatus
+    std::atomic<uint64_t> _rows{0};
+    std::atomic<uint64_t> _bytes{0};
+    std::array<std::atomic<uint64_t>, 5> _poolEvents{};  // By PoolEventKind
+    // Pool occupancy as of the last pool event
+    std::atomic<size_t> _totalConnections{0};
+    std::atomic<size_t> _idleConnections{0};
+    std::atomic<size_t> _waitingThreads{0};
+    std::atomic<uint64_t> _cacheHits{0};
+    std::atomic<uint64_t> _cacheMisses{0};
 };
 
-}  // namespace pg_wrapper
\ No newline at end of file
+namespace detail {
+
+// Times one statement for an Observer; inert when observer is null
+class QueryTimer {
+   public:
+    QueryTimer(Observer* observer, std::string_view sql)
+        : _observer(observer), _sql(sql) {
+        if (_observer) {
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+
+    void succeeded(const Result& result) const {
+        if (_observer) {
+            report(&result, nullptr);
+        }
+    }
+
+    void failed(const std::exception& error) const {
+        if (_observer) {
+            report(nullptr, &error);
+        }
+    }
+
+   private:
+    void report(const Result* result, const std::exception* error) const;
+
+    Observer* _observer;
+    std::string_view _sql;
+    std::chrono::steady_clock::time_point _start;
+};
+
+// Parameter types ParamArena binds itself: numbers, bool, text and NULL,
+// optionally wrapped in std::optional
+template <typename T>
+constexpr bool is_arena_param() {
+    if constexpr (is_optional<T>::value) {
+        return is_arena_param<typename T::value_type>();
+    } else if constexpr (std::is_integral_v<T>) {
+        // Character types mean text to pqxx, not numbers
+        return !std::is_same_v<T, char> && !std::is_same_v<T, signed char> &&
+               !std::is_same_v<T, unsigned char> &&
+               !std::is_same_v<T, wchar_t> && !std::is_same_v<T, char16_t> &&
+               !std::is_same_v<T, char32_t>;
+    } else {
+        return std::is_floating_point_v<T> || std::is_same_v<T, std::string> ||
+               std::is_same_v<T, std::string_view> ||
+               std::is_same_v<T, const char*> || std::is_same_v<T, char*> ||
+               std::is_same_v<T, std::nullptr_t>;
+    }
+}
+
+// Reusable buffer for binding statement parameters. Numbers are written
+// with std::to_chars and string_views copied, each NUL-terminated, and the
+// pqxx::params handed to libpq only hold views into the buffer or into the
+// caller's strings. The buffer keeps its capacity between calls, so once
+// it has grown a statement binds without allocating per parameter.
+// Valid until the next bind().
+class ParamArena {
+   public:
+    template <typename... Args>
+    pqxx::params bind(const Args&... args) {
+        _text.clear();
+        _ends.clear();
+        (write(args), ...);
+
+        pqxx::params params;
+        params.reserve(sizeof...(Args));
+        size_t slot = 0;
+        (append(params, args, slot), ...);
+        return params;
+    }
+
+   private:
+    // Longest shortest-round-trip double, int64 or uint64, plus sign
+    static constexpr size_t kMaxNumberLength = 32;
+
+    // First pass: copy whatever needs the buffer. The buffer may grow
+    // here, so views into it are only taken in the second pass.
+    template <typename T>
+    void write(const T& value) {
+        if constexpr (is_optional<T>::value) {
+            if (value) {
+                write(*value);
+            }
+        } else if constexpr (std::is_same_v<T, std::string_view>) {
+            _text.append(value);
+            end_slot();
+        } else if constexpr (std::is_floating_point_v<T>) {
+            // PostgreSQL's spelling, which to_chars doesn't produce
+            if (std::isnan(value)) {
+                _text.append("NaN");
+            } else if (std::isinf(value)) {
+                _text.append(value < 0 ? "-Infinity" : "Infinity");
+            } else {
+                write_number(value);
+                return;
+            }
+            end_slot();
+        } else if constexpr (std::is_integral_v<T> &&
+                             !std::is_same_v<T, bool>) {
+            write_number(value);
+        }
+    }
+
+    template <typename T>
+    void write_number(T value) {
+        const size_t begin = _text.size();
+        _text.resize(begin + kMaxNumberLength);
+        auto [ptr, ec] = std::to_chars(_text.data() + begin,
+                                       _text.data() + _text.size(), value);
+        (void)ec;  // Cannot overflow kMaxNumberLength
+        _text.resize(ptr - _text.data());
+        end_slot();
+    }
+
+    void end_slot() {
+        _text.push_back('\0');
+        _ends.push_back(_text.size());
+    }
+
+    // Second pass: one parameter per argument, in order
+    template <typename T>
+    void append(pqxx::params& params, const T& value, size_t& slot) const {
+        // String literals arrive as arrays
+        if constexpr (std::is_array_v<T>) {
+            params.append(pqxx::zview(value));
+        } else if constexpr (is_optional<T>::value) {
+            if (value) {
+                append(params, *value, slot);
+            } else {
+                params.append();
+            }
+        } else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+            params.append();
+        } else if constexpr (std::is_same_v<T, bool>) {
+            params.append(pqxx::zview(value ? "true" : "false"));
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            params.append(pqxx::zview(value));
+        } else if constexpr (std::is_pointer_v<T>) {
+            if (value) {
+                params.append(pqxx::zview(value));
+            } else {
+                params.append();
+            }
+        } else {
+            const size_t begin = slot > 0 ? _ends[slot - 1] : 0;
+            const size_t end = _ends[slot++];
+            params.append(pqxx::zview(_text.data() + begin, end - begin - 1));
+        }
+    }
+
+    std::string _text;
+    std::vector<size_t> _ends;  // Offset past each value's NUL
+};
+
+// FNV-1a, usable in constant expressions
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+constexpr uint64_t fnv1a(std::string_view text) {
+    uint64_t hash = kFnvOffset;
+    for (char ch : text) {
+        hash = (hash ^ static_cast<unsigned char>(ch)) * kFnvPrime;
+    }
+    return hash;
+}
+
+// An argument as the parameter type a Statement declares: passed through
+// when it already is one, converted otherwise
+template <typename Param, typename Arg>
+decltype(auto) bind_as(Arg&& arg) {
+    static_assert(std::is_convertible_v<Arg&&, Param>,
+                  "argument does not convert to the Statement's parameter "
+                  "type");
+    if constexpr (std::is_same_v<std::decay_t<Arg>, Param>) {
+        return std::forward<Arg>(arg);
+    } else {
+        return Param(std::forward<Arg>(arg));
+    }
+}
+
+}  // namespace detail
+
+template <typename Signature>
+class Statement;
+
+// SQL fixed at compile time together with its parameter types and row
+// type, e.g.
+//
+//   constexpr pg_wrapper::Statement<std::tuple<int, std::string>(int)>
+//       kUserById("SELECT id, name FROM users WHERE id = $1");
+//
+//   auto users = db.query(kUserById, 42);
+//
+// Its prepared-statement name is derived from a hash of the SQL when the
+// object is constructed, so running it involves no string handling; each
+// connection prepares it the first time it is run there. Arguments are
+// checked against Params at compile time and bound as those types. Use
+// void as RowT for statements that return no rows, and std::string_view
+// rather than std::string for text parameters to avoid a copy.
+template <typename RowT, typename... Params>
+class Statement<RowT(Params...)> {
+   public:
+    using row_type = RowT;
+
+    static constexpr size_t arity = sizeof...(Params);
+
+    // sql must outlive the Statement; a string literal is the usual case
+    constexpr explicit Statement(const char* sql)
+        : _sql(sql), _hash(detail::fnv1a(sql)) {
+        constexpr char kDigits[] = "0123456789abcdef";
+        for (size_t i = 0; i < kPrefix.size(); ++i) {
+            _name[i] = kPrefix[i];
+        }
+        for (size_t i = 0; i < 16; ++i) {
+            const int shift = 60 - 4 * int(i);
+            _name[kPrefix.size() + i] = kDigits[(_hash >> shift) & 0xf];
+        }
+    }
+
+    constexpr const char* sql() const { return _sql; }
+
+    constexpr uint64_t hash() const { return _hash; }
+
+    // Server-side name, NUL-terminated
+    constexpr const char* name() const { return _name.data(); }
+
+   private:
+    // Distinct from the statement cache's pgw_stmt_ names
+    static constexpr std::string_view kPrefix = "pgw_cstmt_";
+
+    const char* _sql;
+    uint64_t _hash;
+    std::array<char, kPrefix.size() + 17> _name{};
+};
+
+// Transaction class
+class Transaction {
+   public:
+    explicit Transaction(pqxx::connection& conn);
+
+    // Moving keeps the Database registration; Pipelines, Inserters and
+    // streams opened on the source must be finished first
+    Transaction(Transaction&& other) noexcept;
+    Transaction& operator=(Transaction&& other) noexcept;
+
+    ~Transaction();
+
+    // Execute query
+    Result exec(const std::string& sql);
+
+    // Execute parameterized query
+    template <typename... Args>
+    Result exec_params(const std::string& sql, Args&&... args);
+
+    // Execute prepared statement
+    template <typename... Args>
+    Result exec_prepared(const std::string& name, Args&&... args);
+
+    // Execute a Statement, preparing it on this connection on first use
+    template <typename RowT, typename... Params, typename... Args>
+    Result exec_prepared(const Statement<RowT(Params...)>& stmt,
+                         Args&&... args);
+
+    // Execute a Statement and decode its rows as RowT
+    template <typename RowT, typename... Params, typename... Args>
+    std::vector<RowT> query(const Statement<RowT(Params...)>& stmt,
+                            Args&&... args);
+
+    // Commit transaction
+    void commit();
+
+    // Abort transaction
+    void abort();
+
+    // Quote and escape values
+    std::string quote(const std::string& value);
+
+    std::string quote_name(const std::string& name);
+
+    // Batch queries on this transaction. Complete the pipeline before
+    // committing.
+    Pipeline pipeline();
+
+    // COPY rows into table within this transaction. Finish the inserter
+    // before running other queries or committing.
+    Inserter inserter(const std::string& table,
+                      const std::vector<std::string>& columns);
+
+    // Stream a query's rows as typed tuples within this transaction
+    template <typename... Types>
+    StreamingResult<Types...> stream(const std::string& sql);
+
+    // Open a SAVEPOINT: a nested Transaction whose commit() releases it and
+    // whose abort() (or destruction) rolls back only the work done through
+    // it. Use the savepoint, not this transaction, until it ends; one may
+    // be open at a time, and it can open savepoints of its own.
+    Transaction savepoint(const std::string& name = "");
+
+   private:
+    friend class Database;
+    friend class Pipeline;
+    friend class Inserter;
+    template <typename... Types>
+    friend class StreamingResult;
+
+    // Transaction registered with its Database so it can be reset
+    Transaction(pqxx::connection& conn, Database* owner);
+
+    Transaction(std::unique_ptr<pqxx::transaction_base> txn, Database* owner);
+
+    Transaction(std::unique_ptr<pqxx::transaction_base> txn,
+                Transaction& parent);
+
+    // Unregister from the owning Database and, for a savepoint, its parent
+    void detach();
+
+    // Take over other's links to its parent and open savepoint
+    void relink(Transaction& other) noexcept;
+
+    // Roll back the open savepoint, which must end before its parent does
+    void abort_savepoint() noexcept;
+
+    // The owning Database's observer, if any
+    Observer* observer() const;
+
+    // The owning Database's parameter buffer, or this transaction's own
+    detail::ParamArena& param_arena();
+
+    // Run the already prepared statement name, reporting it as label
+    template <typename... Args>
+    Result run_prepared(pqxx::zview name, std::string_view label,
+                        Args&&... args);
+
+    // Whether every argument can be bound through the ParamArena; others
+    // (arrays, bytea, pqxx::params) go to pqxx unchanged
+    template <typename... Args>
+    static constexpr bool binds_to_arena =
+        (detail::is_arena_param<std::decay_t<Args>>() && ...);
+
+    std::unique_ptr<pqxx::transaction_base> _txn;
+    bool _committed;
+    Database* _owner{nullptr};
+    std::unique_ptr<detail::ParamArena> _ownArena;  // Without an owner
+    Transaction* _parent{nullptr};     // When this is a savepoint
+    Transaction* _savepoint{nullptr};  // Open savepoint within this one
+};
+
+// Handle to a query queued on a Pipeline
+struct QueryHandle {
+    pqxx::pipeline::query_id id;
+};
+
+// Sends many independent queries in as few round trips as possible
+// (pqxx::pipeline). Parameters are bound client-side as quoted literals and
+// prepared statements run via EXECUTE. Each query's outcome is kept
+// separately, so a failure is reported through the handles it affected,
+// but queries are not isolated from each other: pqxx sends a batch as one
+// multi-statement string, which the server runs as a single transaction.
+// Outside a Transaction, one failing query rolls back the rest of its batch
+// and stops the queries after it; inside one, it aborts the transaction.
+// Dropping a pipeline cancels queries not yet completed.
+class Pipeline {
+   public:
+    Pipeline(Pipeline&&) noexcept;
+    Pipeline& operator=(Pipeline&&) noexcept;
+
+    ~Pipeline();
+
+    // Queue a query
+    QueryHandle exec(const std::string& sql);
+
+    // Queue a parameterized query
+    template <typename... Args>
+    QueryHandle exec_params(const std::string& sql, Args&&... args);
+
+    // Queue a prepared statement
+    template <typename... Args>
+    QueryHandle exec_prepared(const std::string& name, Args&&... args);
+
+    // Result of a queued query, waiting for it if needed. Throws that
+    // query's QueryError/DatabaseError if it failed.
+    Result get(QueryHandle handle);
+
+    // Wait for every queued query. Does not throw for failed queries; their
+    // errors are reported by get().
+    void complete();
+
+    // Queries held back before sending a batch (see pqxx::pipeline::retain)
+    void retain(int maxQueries);
+
+    // Send held-back queries and read whatever results have arrived,
+    // without blocking
+    void poll();
+
+    // Whether get(handle) can return without waiting on the server
+    bool ready(QueryHandle handle) const;
+
+   private:
+    friend class Transaction;
+    friend class Database;
+    friend class AsyncConnection;
+
+    // Pipeline on a transaction owned elsewhere
+    explicit Pipeline(Transaction& txn);
+
+    // Pipeline that owns its transaction
+    explicit Pipeline(std::unique_ptr<Transaction> txn);
+
+    struct Outcome {
+        std::optional<Result> result;
+        std::exception_ptr error;
+    };
+
+    QueryHandle insert(const std::string& sql);
+
+    void fetch(pqxx::pipeline::query_id id);
+
+    // get(), then forget the query, for long-lived pipelines
+    Result take(QueryHandle handle);
+
+    // Unmark the statements of PREPAREs whose outcome was never fetched
+    void forget_prepares() noexcept;
+
+    // Replace $1..$n outside quotes and comments with literals
+    static std::string bind(const std::string& sql,
+                            const std::vector<std::string>& literals);
+
+    // Destroyed after _pipe; move assignment resets _pipe by hand first
+    std::unique_ptr<Transaction> _ownedTxn;
+    Transaction* _txn;
+    std::unique_ptr<pqxx::pipeline> _pipe;
+    // Ids not yet fetched, in insertion order
+    std::deque<pqxx::pipeline::query_id> _queued;
+    std::unordered_map<pqxx::pipeline::query_id, Outcome> _outcomes;
+    // In-band PREPAREs not yet fetched. Their names are marked prepared
+    // when queued, so a second exec_prepared() doesn't PREPARE again, and
+    // unmarked if the PREPARE fails or is skipped.
+    struct PendingPrepare {
+        Database* db;
+        std::string name;
+    };
+    std::unordered_map<pqxx::pipeline::query_id, PendingPrepare> _prepares;
+};
+
+// Options for COPY-based bulk loading
+struct BulkInsertOptions {
+    // Commit every chunkRows rows, so a failure only loses the current
+    // chunk and the server never holds one huge transaction (0 = commit
+    // once at the end). Ignored for inserters on a caller's Transaction.
+    size_t chunkRows{0};
+};
+
+// Options for multi-row INSERT and upsert through Database::batch_insert()
+struct BatchInsertOptions {
+    // Rows per INSERT statement, capped so a batch stays within
+    // PostgreSQL's 65535 bind parameters
+    size_t batchRows{500};
+
+    // ON CONFLICT target columns; empty for a plain INSERT
+    std::vector<std::string> conflictColumns;
+
+    // Columns set from EXCLUDED on conflict; empty means DO NOTHING
+    std::vector<std::string> updateColumns;
+};
+
+enum class IsolationLevel { ReadCommitted, RepeatableRead, Serializable };
+
+// Characteristics of a transaction from Database::begin_transaction()
+struct TransactionOptions {
+    IsolationLevel isolation{IsolationLevel::ReadCommitted};
+
+    // READ ONLY: writes fail, and hot standbys accept the transaction
+    bool readOnly{false};
+
+    // DEFERRABLE: with Serializable and readOnly, wait once for a snapshot
+    // that can't conflict, then run with no serialization checks or
+    // failures; suited to long reports. PostgreSQL ignores it otherwise.
+    bool deferrable{false};
+};
+
+// How Database::run_in_transaction() retries a transaction the server
+// rolled back (TransactionRollbackError: serialization failure, deadlock)
+struct RetryPolicy {
+    // Attempts in total, including the first
+    size_t maxAttempts{5};
+
+    // Backoff before the first retry, multiplied by backoffMultiplier after
+    // each one up to maxBackoff. The actual sleep is drawn uniformly from
+    // [0, backoff] so clients that collided don't collide again.
+    std::chrono::milliseconds initialBackoff{10};
+    std::chrono::milliseconds maxBackoff{1000};
+    double backoffMultiplier{2.0};
+};
+
+namespace detail {
+
+// Uniformly random duration in [0, ceiling]
+std::chrono::microseconds jittered(std::chrono::microseconds ceiling);
+
+}  // namespace detail
+
+// Streams rows into a table with COPY ... FROM STDIN (pqxx::stream_to).
+// Rows are encoded straight onto the wire; no INSERT statement is built.
+// Writes block while the server is behind, which throttles the producer.
+class Inserter {
+   public:
+    Inserter(Inserter&&) noexcept;
+    Inserter& operator=(Inserter&&) noexcept;
+
+    // Rolls back the current chunk if finish() was not called
+    ~Inserter();
+
+    // Write one row given as separate values
+    template <typename... Values>
+    void write_values(const Values&... values);
+
+    // Write one row given as a tuple or container of values
+    template <typename Row>
+    void write_row(const Row& row);
+
+    // End the COPY and commit the last chunk; returns total rows written
+    size_t finish();
+
+    // Rows written so far
+    size_t rows() const { return _rows; }
+
+   private:
+    friend class Database;
+    friend class Transaction;
+
+    // Inserter committing its own chunks on db
+    Inserter(Database& db, const std::string& table,
+             const std::vector<std::string>& columns,
+             const BulkInsertOptions& options);
+
+    // Inserter inside a caller's transaction
+    Inserter(Transaction& txn, const std::string& table,
+             const std::vector<std::string>& columns);
+
+    // Start a COPY (and, for owned chunks, a transaction) if none is open
+    void open_chunk();
+
+    // Complete the COPY and commit an owned chunk
+    void close_chunk();
+
+    // Count a written row, rolling over to the next chunk when full
+    void row_written();
+
+    Database* _db{nullptr};
+    Transaction* _txn{nullptr};
+    // Declared before _chunkTxn so move assignment ends the old COPY while
+    // its transaction is still alive
+    std::unique_ptr<pqxx::stream_to> _stream;
+    std::unique_ptr<Transaction> _chunkTxn;
+    std::string _table;
+    std::string _columns;  // Comma-separated column list
+    size_t _chunkRows{0};
+    size_t _rowsInChunk{0};
+    size_t _rows{0};
+};
+
+// A query's rows streamed with COPY ... TO STDOUT (pqxx::stream_from) as
+// std::tuple<Types...>, one at a time. Memory use stays bounded by one row
+// and the first row is available as soon as the server sends it. Single
+// pass: iterate once, and run nothing else on the connection meanwhile.
+template <typename... Types>
+class StreamingResult {
+   public:
+    using value_type = std::tuple<Types...>;
+
+    class iterator {
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = StreamingResult::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        iterator() = default;
+
+        reference operator*() const { return _owner->_row; }
+        pointer operator->() const { return &_owner->_row; }
+
+        bool operator==(const iterator& itr) const {
+            return _owner == itr._owner;
+        }
+        bool operator!=(const iterator& itr) const { return !(*this == itr); }
+
+        iterator& operator++() {
+            if (!_owner->read_next()) {
+                _owner = nullptr;
+            }
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+       private:
+        friend class StreamingResult;
+
+        explicit iterator(StreamingResult* owner) : _owner(owner) {}
+
+        StreamingResult* _owner{nullptr};  // Null at end of stream
+    };
+
+    StreamingResult(StreamingResult&&) noexcept = default;
+    StreamingResult& operator=(StreamingResult&&) noexcept = default;
+
+    ~StreamingResult() {
+        // The stream must not outlive its transaction
+        _stream.reset();
+    }
+
+    // Reads the first row on the first call
+    iterator begin() {
+        if (!_started) {
+            _started = true;
+            if (!read_next()) {
+                return end();
+            }
+        }
+        return _done ? end() : iterator(this);
+    }
+
+    iterator end() { return iterator(); }
+
+    // Read the next row; false at end of stream
+    bool read(value_type& row) {
+        _started = true;
+        if (!read_next()) {
+            return false;
+        }
+        row = std::move(_row);
+        return true;
+    }
+
+   private:
+    friend class Database;
+    friend class Transaction;
+
+    // Streams on txn, or on owned if txn is null
+    StreamingResult(std::unique_ptr<Transaction> owned, Transaction* txn,
+                    const std::string& sql)
+        : _ownedTxn(std::move(owned)) {
+        Transaction& target = txn ? *txn : *_ownedTxn;
+        try {
+            _stream = std::make_unique<pqxx::stream_from>(
+                pqxx::stream_from::query(*target._txn, sql));
+        } catch (const pqxx::sql_error& e) {
+            detail::throw_query_error(e);
+        } catch (const std::exception& e) {
+            detail::throw_database_error(e);
+        }
+    }
+
+    bool read_next() {
+        if (_done) {
+            return false;
+        }
+        try {
+            if (*_stream >> _row) {
+                return true;
+            }
+            _done = true;
+            _stream->complete();
+            if (_ownedTxn) {
+                _ownedTxn->commit();
+            }
+            return false;
+        } catch (const DatabaseError&) {
+            _done = true;
+            throw;
+        } catch (const pqxx::sql_error& e) {
+            _done = true;
+            detail::throw_query_error(e);
+        } catch (const std::exception& e) {
+            _done = true;
+            detail::throw_database_error(e);
+        }
+    }
+
+    // Declared before _ownedTxn so move assignment ends the old stream
+    // while its transaction is still alive
+    std::unique_ptr<pqxx::stream_from> _stream;
+    std::unique_ptr<Transaction> _ownedTxn;
+    value_type _row;
+    bool _started{false};
+    bool _done{false};
+};
+
+// Statement cache counters
+struct StatementCacheStats {
+    size_t size{0};
+    size_t capacity{0};
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t evictions{0};
+};
+
+// Bounded LRU map from SQL text to the name it was prepared under
+class StatementCache {
+   public:
+    explicit StatementCache(size_t capacity);
+
+    // Statement name for sql, or nullptr on a miss
+    const std::string* find(const std::string& sql);
+
+    // Remember sql as prepared under name. If that pushes the cache over
+    // capacity, the least recently used name is moved into evicted.
+    const std::string& insert(const std::string& sql, std::string name,
+                              std::optional<std::string>& evicted);
+
+    // Forget every entry, returning the statement names that were cached
+    std::vector<std::string> clear();
+
+    StatementCacheStats stats() const;
+
+   private:
+    struct Entry {
+        std::string sql;
+        std::string name;
+    };
+
+    std::list<Entry> _lru;  // Most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> _index;
+    size_t _capacity;
+    uint64_t _hits{0};
+    uint64_t _misses{0};
+    uint64_t _evictions{0};
+};
+
+// Named statements shared by a set of connections (typically a pool's).
+// Each connection prepares a statement the first time it executes it.
+class PreparedRegistry {
+   public:
+    // Throws std::invalid_argument if name is registered with other SQL
+    void add(const std::string& name, const std::string& sql);
+
+    // SQL registered under name, if any
+    std::optional<std::string> find(const std::string& name) const;
+
+   private:
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, std::string> _statements;
+};
+
+struct QueryCacheOptions {
+    // How long a result is served after it was fetched (0 = until evicted
+    // or invalidated)
+    std::chrono::milliseconds ttl{1000};
+
+    // Bound on the text of cached results, split evenly across shards;
+    // least recently used entries go first
+    size_t maxBytes{64 << 20};
+
+    // Independently locked partitions of the cache
+    size_t shards{16};
+};
+
+struct QueryCacheStats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t evictions{0};      // Dropped to stay within maxBytes
+    uint64_t expirations{0};    // Found older than ttl
+    uint64_t invalidations{0};  // Dropped by invalidate() or clear()
+    size_t entries{0};
+    size_t bytes{0};
+};
+
+// Client-side cache of query results keyed by SQL text and parameters, for
+// hot read-mostly lookups. Entries are immutable Result snapshots shared
+// with every caller that hits them. Each entry records the tables its
+// query reads so writers can invalidate() them. Thread-safe: one cache is
+// typically shared by a pool's connections (PoolOptions::queryCache).
+class QueryCache : public std::enable_shared_from_this<QueryCache> {
+   public:
+    explicit QueryCache(const QueryCacheOptions& options = {});
+
+    // Cache key for sql run with args
+    template <typename... Args>
+    static std::string key(const std::string& sql, const Args&... args);
+
+    // Fresh result cached under key, if any
+    std::optional<Result> find(const std::string& key);
+
+    // Read before running a query that will be insert()ed
+    uint64_t generation() const;
+
+    // Cache result under key as reading tables. Dropped if anything was
+    // invalidated since generation was read, as result may predate it.
+    void insert(const std::string& key, const Result& result,
+                std::initializer_list<std::string_view> tables,
+                uint64_t generation);
+
+    // Drop every entry that reads table; returns how many were dropped
+    size_t invalidate(std::string_view table);
+
+    void clear();
+
+    // invalidate() the table named by each notification's payload on
+    // channel, e.g. sent by a trigger with pg_notify(channel,
+    // TG_TABLE_NAME); clear() when the subscriber reconnects. The cache
+    // must be owned by a std::shared_ptr; the subscription holds it weakly.
+    void invalidate_on(Subscriber& subscriber, const std::string& channel);
+
+    QueryCacheStats stats() const;
+
+   private:
+    struct Entry {
+        std::string key;
+        Result result;
+        std::chrono::steady_clock::time_point expires;
+        size_t bytes;
+        std::vector<std::string> tables;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;  // Most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator>
+            index;
+        size_t bytes{0};
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t evictions{0};
+        uint64_t expirations{0};
+        uint64_t invalidations{0};
+    };
+
+    Shard& shard_for(const std::string& key);
+
+    // Remove an entry from its shard, with the shard's mutex held
+    static void erase(Shard& shard, std::list<Entry>::iterator itr);
+
+    QueryCacheOptions _options;
+    size_t _shardBytes;
+    std::vector<Shard> _shards;
+    std::atomic<uint64_t> _generation{0};
+};
+
+// How Database::exec(), exec_params() and exec_prepared() run a statement
+enum class ExecMode {
+    // True autocommit via pqxx::nontransaction: one round trip
+    AutoCommit,
+    // BEGIN and COMMIT around every statement
+    Transactional,
+};
+
+// Database connection class
+class Database {
+   public:
+    // Constructor with connection string
+    explicit Database(const std::string& connectionString);
+
+    // Constructor with individual parameters
+    Database(const std::string& host, const std::string& port,
+             const std::string& dbname, const std::string& user,
+             const std::string& password);
+
+    // Check if connected
+    bool is_open() const { return _conn && _conn->is_open(); }
+
+    // When the connection was established
+    std::chrono::steady_clock::time_point connected_at() const {
+        return _connectedAt;
+    }
+
+    // Whether the server end of the connection is still there, judged from
+    // local socket state without a round trip. Closes the connection if
+    // not.
+    bool is_alive();
+
+    // Round-trip check with SELECT 1. Closes the connection on failure.
+    bool ping();
+
+    // When the connection was last found alive (initially connected_at())
+    std::chrono::steady_clock::time_point checked_at() const {
+        return _checkedAt;
+    }
+
+    // Get connection info
+    std::string dbname() const { return _conn->dbname(); }
+    std::string username() const { return _conn->username(); }
+    std::string hostname() const { return _conn->hostname(); }
+    std::string port() const { return _conn->port(); }
+
+    // Create transaction: BEGIN with the given isolation and access mode
+    Transaction begin_transaction(const TransactionOptions& options = {});
+
+    // Run fn(Transaction&) in a transaction opened with options and commit
+    // it, running both again after a TransactionRollbackError as policy
+    // allows; returns what fn returns. fn must be safe to repeat and may
+    // commit itself. Other errors, including ConnectionLostError, propagate
+    // at once: this connection can't be reopened, so retry those on a
+    // fresh lease.
+    template <typename Fn>
+    auto run_in_transaction(Fn&& fn, const RetryPolicy& policy = {},
+                            const TransactionOptions& options = {})
+        -> std::invoke_result_t<Fn&, Transaction&>;
+
+    // Batch statements over an autocommit connection. A batch still commits
+    // or rolls back as a whole; see Pipeline.
+    Pipeline pipeline();
+
+    // Single-statement execution mode (AutoCommit by default)
+    void set_exec_mode(ExecMode mode) { _execMode = mode; }
+    ExecMode exec_mode() const { return _execMode; }
+
+    // Execute query without transaction (auto-commit)
+    Result exec(const std::string& sql);
+
+    // Execute parameterized query without transaction
+    template <typename... Args>
+    Result exec_params(const std::string& sql, Args&&... args);
+
+    // Prepare statement
+    void prepare(const std::string& name, const std::string& sql);
+
+    // Execute prepared statement without transaction
+    template <typename... Args>
+    Result exec_prepared(const std::string& name, Args&&... args);
+
+    // Execute a Statement without transaction, preparing it on this
+    // connection on first use
+    template <typename RowT, typename... Params, typename... Args>
+    Result exec_prepared(const Statement<RowT(Params...)>& stmt,
+                         Args&&... args);
+
+    // Execute a Statement and decode its rows as RowT
+    template <typename RowT, typename... Params, typename... Args>
+    std::vector<RowT> query(const Statement<RowT(Params...)>& stmt,
+                            Args&&... args);
+
+    // exec_params() answered from the query cache while a fresh result for
+    // the same SQL and arguments is there. tables are the tables the query
+    // reads, for QueryCache::invalidate(). Without a cache this is
+    // exec_params().
+    template <typename... Args>
+    Result exec_cached(std::initializer_list<std::string_view> tables,
+                       const std::string& sql, Args&&... args);
+
+    // Cache used by exec_cached() (null to disable)
+    void set_query_cache(std::shared_ptr<QueryCache> cache);
+
+    // Opt-in: exec_params() prepares each distinct SQL text on first use and
+    // runs it as a prepared statement afterwards, keeping at most capacity
+    // statements on the server (0 disables the cache)
+    void enable_statement_cache(size_t capacity);
+
+    StatementCacheStats statement_cache_stats() const;
+
+    // Statements from registry are prepared on this connection lazily, the
+    // first time exec_prepared() names them
+    void set_prepared_registry(
+        std::shared_ptr<const PreparedRegistry> registry);
+
+    // Report every statement run on this connection to observer (null to
+    // stop)
+    void set_observer(std::shared_ptr<Observer> observer);
+
+    // Utility methods for common operations
+
+    // Check if table exists
+    bool table_exists(const std::string& tableName);
+
+    // Get table column names
+    std::vector<std::string> get_columns(const std::string& tableName);
+
+    // Simple insert helper
+    template <typename... Args>
+    void insert(const std::string& table,
+                const std::vector<std::string>& columns, Args&&... values);
+
+    // COPY rows into table; prefer this to insert() for bulk loads
+    Inserter inserter(const std::string& table,
+                      const std::vector<std::string>& columns,
+                      const BulkInsertOptions& options = {});
+
+    // Stream a query's rows as typed tuples without materializing them
+    template <typename... Types>
+    StreamingResult<Types...> stream(const std::string& sql);
+
+    // COPY a range of tuples into table; returns rows written
+    template <typename Rows>
+    size_t bulk_insert(const std::string& table,
+                       const std::vector<std::string>& columns,
+                       const Rows& rows, const BulkInsertOptions& options = {});
+
+    // Multi-row INSERT, or upsert with options.conflictColumns, of a range of
+    // tuples in one transaction. Each full batch runs as a statement
+    // prepared once per table and column shape. Returns rows affected.
+    template <typename Rows>
+    size_t batch_insert(const std::string& table,
+                        const std::vector<std::string>& columns,
+                        const Rows& rows,
+                        const BatchInsertOptions& options = {});
+
+    // Socket of the connection, for registering with poll/epoll or an
+    // event loop
+    int socket() const;
+
+    // Roll back any transaction still open on this connection
+    void reset();
+
+    // Close connection
+    void close();
+
+   private:
+    friend class Transaction;
+    friend class Pipeline;
+    friend class Inserter;
+    friend class ConnectionPool;
+
+    // Explicit (BEGIN/COMMIT) transaction owned by the caller
+    std::unique_ptr<Transaction> new_transaction();
+
+    // Autocommit (pqxx::nontransaction) transaction owned by the caller
+    std::unique_ptr<Transaction> new_nontransaction();
+
+    // Transaction for one exec*() call, according to the exec mode
+    Transaction begin_statement();
+
+    // SQL for name if it is registered but not yet prepared here; marks it
+    // prepared, for callers that PREPARE it in-band and unmark it with
+    // _preparedNames.erase() if that fails
+    std::optional<std::string> take_unprepared(const std::string& name);
+
+    // Name of the cached statement for sql, preparing it on a miss
+    const std::string& cached_statement(const std::string& sql);
+
+    // Prepare name from the registry if this connection hasn't yet
+    void ensure_prepared(const std::string& name);
+
+    // Prepare a Statement's SQL as name if this connection hasn't yet;
+    // throws std::invalid_argument if name already holds different SQL
+    void ensure_prepared(uint64_t hash, const char* name, const char* sql);
+
+    // Name of the prepared INSERT of rows rows with this shape, preparing
+    // it on first use. Valid until the next call, which may deallocate it.
+    const std::string& insert_statement(const std::string& table,
+                                        const std::vector<std::string>& columns,
+                                        size_t rows,
+                                        const BatchInsertOptions& options);
+
+    std::unique_ptr<pqxx::connection> _conn;
+    std::chrono::steady_clock::time_point _connectedAt;
+    std::chrono::steady_clock::time_point _checkedAt;
+    ExecMode _execMode{ExecMode::AutoCommit};
+    Transaction* _activeTxn{nullptr};  // Open transaction from this Database
+    std::unique_ptr<StatementCache> _stmtCache;
+    uint64_t _stmtCounter{0};  // Source of unique cached statement names
+    std::shared_ptr<const PreparedRegistry> _registry;
+    std::unordered_set<std::string> _preparedNames;  // Prepared on _conn
+    // Statements prepared on _conn, by the hash their name encodes; the SQL
+    // is kept to catch two statements whose hashes collide
+    struct PreparedStatement {
+        const char* source;  // Last Statement::sql() seen, for a quick check
+        std::string sql;
+    };
+    std::unordered_map<uint64_t, PreparedStatement> _preparedStatements;
+    // Prepared INSERT names, by table, columns, row count and conflict
+    // clause; least recently used shapes are deallocated past the capacity
+    static constexpr size_t kInsertStatementCapacity = 64;
+    StatementCache _insertStatements{kInsertStatementCapacity};
+    // Reused by every statement's parameter binding
+    detail::ParamArena _paramArena;
+    std::shared_ptr<Observer> _observer;
+    std::shared_ptr<QueryCache> _queryCache;
+};
+
+// Snapshot of connection pool usage, for sizing maxConnections
+struct PoolStats {
+    size_t maxConnections{0};
+    size_t totalConnections{0};  // Live connections (idle + in use)
+    size_t idleConnections{0};
+    size_t waitingThreads{0};
+
+    uint64_t acquisitions{0};  // Successful acquire() calls
+    uint64_t waits{0};         // Acquisitions that had to block
+    uint64_t timeouts{0};      // Acquisitions that gave up
+    std::chrono::nanoseconds totalWaitTime{0};
+    std::chrono::nanoseconds maxWaitTime{0};
+
+    uint64_t replacedConnections{0};  // Broken connections reopened
+    uint64_t retiredConnections{0};   // Closed for age or idleness
+
+    // Mean time spent blocked per acquisition
+    std::chrono::nanoseconds average_wait_time() const;
+};
+
+// Move-only lease on a pooled connection; returns it to the pool when
+// destroyed, so a connection is never leaked on early return or exception
+class PooledConnection {
+   public:
+    PooledConnection() = default;
+    PooledConnection(ConnectionPool* pool, std::unique_ptr<Database> conn);
+
+    PooledConnection(PooledConnection&& other) noexcept;
+    PooledConnection& operator=(PooledConnection&& other) noexcept;
+
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    ~PooledConnection();
+
+    Database* operator->() const { return _conn.get(); }
+    Database& operator*() const { return *_conn; }
+    Database* get() const { return _conn.get(); }
+
+    explicit operator bool() const { return _conn != nullptr; }
+
+    // Return the connection to the pool before the lease goes out of scope
+    void release();
+
+   private:
+    ConnectionPool* _pool{nullptr};
+    std::unique_ptr<Database> _conn;
+};
+
+namespace detail {
+
+// Bounded lock-free multi-producer/multi-consumer queue (Vyukov's
+// sequence-numbered ring). Capacity is rounded up to a power of two.
+template <typename T>
+class MpmcQueue {
+   public:
+    explicit MpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _cells = std::make_unique<Cell[]>(size);
+        _mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    // Returns false if the queue is full
+    bool try_push(T value) {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool try_pop(T& value) {
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & _mask];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (_dequeuePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + _mask + 1,
+                                        std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+   private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask{0};
+    alignas(64) std::atomic<size_t> _enqueuePos{0};
+    alignas(64) std::atomic<size_t> _dequeuePos{0};
+};
+
+}  // namespace detail
+
+// How idle connections are shared between threads
+enum class PoolMode {
+    // One mutex-protected idle list
+    Shared,
+    // Per-thread slots over a lock-free free list, so a thread usually gets
+    // back the connection it just returned without touching the pool mutex.
+    // The mutex path is used only to open connections and to queue waiters.
+    ThreadAffinity,
+};
+
+// TCP keepalive settings, passed to libpq as connection parameters
+struct KeepaliveOptions {
+    bool enabled{false};
+    std::chrono::seconds idle{0};      // Before the first probe (0 = OS)
+    std::chrono::seconds interval{0};  // Between probes (0 = OS)
+    int count{0};                      // Lost probes before giving up
+};
+
+// Connection pool sizing and maintenance settings
+struct PoolOptions {
+    size_t maxConnections{10};
+
+    // Connections opened at construction and kept ready by the
+    // maintenance thread
+    size_t minIdle{0};
+
+    // Retire connections older than this (0 = unlimited)
+    std::chrono::milliseconds maxLifetime{0};
+
+    // Retire connections idle longer than this, down to minIdle (0 = never)
+    std::chrono::milliseconds idleTimeout{0};
+
+    // How often the maintenance thread sweeps the idle list
+    std::chrono::milliseconds maintenanceInterval{1000};
+
+    // Reconnect delay after a failed open, doubled up to the maximum
+    std::chrono::milliseconds reconnectBackoff{100};
+    std::chrono::milliseconds maxReconnectBackoff{10000};
+
+    PoolMode mode{PoolMode::Shared};
+
+    // ThreadAffinity slot count (0 = hardware concurrency). Connections
+    // parked in slots are not subject to idleTimeout.
+    size_t affinitySlots{0};
+
+    // Statement cache capacity for every connection the pool opens
+    // (0 = disabled). See Database::enable_statement_cache().
+    size_t statementCacheSize{0};
+
+    // Receives pool events, and query events from every pooled connection
+    std::shared_ptr<Observer> observer{};
+
+    // Result cache for exec_cached() on every pooled connection
+    std::shared_ptr<QueryCache> queryCache{};
+
+    // Check-on-borrow: before handing out a connection not checked within
+    // validateInterval (0 = every time), look at its socket for the server
+    // having closed it. Local only, no round trip; a dead connection is
+    // replaced by a new one for the same caller.
+    bool validateOnBorrow{false};
+    std::chrono::milliseconds validateInterval{1000};
+
+    // The maintenance thread sends SELECT 1 to idle connections not
+    // checked for this long (0 = never), to every such connection at once,
+    // and replaces the ones that fail. Connections parked in affinity
+    // slots are not probed.
+    std::chrono::milliseconds idleProbeInterval{0};
+
+    // Applied to every connection the pool opens
+    KeepaliveOptions keepalive{};
+};
+
+// Options for ConnectionPool::parallel_scan()
+struct ParallelScanOptions {
+    // Select list sent for every partition
+    std::string columns{"*"};
+
+    // Connections scanning at once, including the one holding the
+    // snapshot (0 = one per partition). Capped at the connections the pool
+    // can hand out without waiting; partitions beyond that wait for a
+    // worker to finish its current one.
+    size_t workers{0};
+
+    // Rows per FETCH, and so per callback
+    size_t batchRows{10000};
+
+    // How long to wait for the snapshot-holding connection
+    std::chrono::milliseconds leaseTimeout{30000};
+};
+
+// Receives one FETCH batch of partition's rows. Runs on scanning threads,
+// concurrently for different partitions but in order within one.
+using ScanCallback =
+    std::function<void(size_t partition, const Result& rows)>;
+
+// Connection pool class for multi-threaded applications
+class ConnectionPool {
+   public:
+    explicit ConnectionPool(const std::string& connectionString,
+                            size_t maxConnections = 10);
+
+    ConnectionPool(const std::string& connectionString,
+                   const PoolOptions& options);
+
+    ~ConnectionPool();
+
+    // Non-blocking: returns nullptr if the pool is exhausted
+    std::unique_ptr<Database> get_connection();
+
+    // Blocking: waits up to timeout for a connection, serving waiters in
+    // arrival order. Throws PoolTimeoutError if none became available.
+    std::unique_ptr<Database> acquire(std::chrono::milliseconds timeout);
+
+    // Blocking acquire() wrapped in a lease that returns itself
+    PooledConnection lease(std::chrono::milliseconds timeout);
+
+    // Resets and returns conn; broken connections are replaced in the
+    // background rather than failing the next caller
+    void return_connection(std::unique_ptr<Database> conn);
+
+    // Wait-time and occupancy statistics
+    PoolStats stats() const;
+
+    // Make a prepared statement available on every pooled connection,
+    // current and future. Each connection prepares it on first use.
+    void register_prepared(const std::string& name, const std::string& sql);
+
+    // Read all of table split into partitions, scanned at the same time on
+    // separate pooled connections that share one snapshot
+    // (pg_export_snapshot), so together they see exactly one consistent
+    // copy of the table. Partitions are integer keyColumn ranges between
+    // its MIN and MAX (NULL keys go to partition 0) or, if keyColumn is
+    // empty, ctid block ranges; those need PostgreSQL 14 or later, and
+    // older servers get a single partition. Each partition is read through
+    // a cursor and handed to callback in batches. Returns the rows read;
+    // the first error stops every worker and is rethrown.
+    //
+    // table, keyColumn and options.columns are pasted into the SQL as is,
+    // like batch_insert()'s names: quote mixed-case or reserved
+    // identifiers with Transaction::quote_name() and never pass untrusted
+    // input.
+    size_t parallel_scan(const std::string& table,
+                         const std::string& keyColumn, size_t partitions,
+                         const ScanCallback& callback,
+                         const ParallelScanOptions& options = {});
+
+   private:
+    // A thread blocked in acquire(); woken individually, in FIFO order
+    struct Waiter {
+        std::condition_variable cv;
+        std::unique_ptr<Database> conn;  // Null means "create a new one"
+        bool ready{false};
+    };
+
+    // An idle connection and when it was last returned
+    struct IdleConnection {
+        std::unique_ptr<Database> conn;
+        std::chrono::steady_clock::time_point idleSince;
+    };
+
+    // Open and configure a new connection
+    std::unique_ptr<Database> open_connection() const;
+
+    // Open a connection for a slot already counted in _currentConnections.
+    // Called without _mutex held; releases the slot if opening fails.
+    std::unique_ptr<Database> open_reserved();
+
+    // Give conn (or its slot if null) to the oldest waiter, if any
+    bool hand_off(std::unique_ptr<Database>& conn);
+
+    // Hand conn to a waiter, or park it on the idle list
+    void make_available(std::unique_ptr<Database> conn);
+
+    // Free the slot of a connection that was dropped
+    void release_slot();
+
+    bool expired(const Database& conn,
+                 std::chrono::steady_clock::time_point now) const;
+
+    void record_wait(std::chrono::nanoseconds waited);
+
+    // Report a pool event to the observer, if any
+    void notify(PoolEventKind kind, std::chrono::nanoseconds wait = {});
+
+    // Background thread: reopens broken connections, keeps minIdle
+    // connections ready and retires old or long-idle ones
+    void run_maintenance();
+
+    // Remove expired idle connections; caller destroys them unlocked
+    std::vector<std::unique_ptr<Database>> take_expired();
+
+    // Check-on-borrow: conn, or a new connection in its slot if conn's
+    // socket shows it died. Called without _mutex held.
+    std::unique_ptr<Database> checked(std::unique_ptr<Database> conn);
+
+    // SELECT 1 on idle connections due for a probe, all sent before any
+    // reply is awaited; survivors go back, the rest are reopened. Called
+    // and returns with lock held, releasing it meanwhile.
+    void probe_idle(std::unique_lock<std::mutex>& lock);
+
+    // ThreadAffinity fast path: park conn in this thread's slot or the free
+    // list. Leaves conn set if the slow path must handle it.
+    bool park_cached(std::unique_ptr<Database>& conn);
+
+    // ThreadAffinity fast path: this thread's slot, then the free list, then
+    // (if anySlot) every other thread's slot. Null in Shared mode.
+    std::unique_ptr<Database> take_cached(bool anySlot);
+
+    // A per-thread cache slot, padded to avoid false sharing
+    struct alignas(64) AffinitySlot {
+        std::atomic<Database*> conn{nullptr};
+    };
+
+    std::string _connectionString;
+    PoolOptions _options;
+    std::shared_ptr<PreparedRegistry> _registry;
+    std::vector<IdleConnection> _pool;  // Oldest idle at the front
+    std::deque<Waiter*> _waiters;
+    mutable std::mutex _mutex;
+    size_t _maxConnections;
+    size_t _currentConnections{0};  // Tracks live connections
+    PoolStats _stats;
+
+    std::thread _worker;
+    std::condition_variable _workerCv;
+    size_t _pendingOpens{0};  // Slots the maintenance thread must fill
+    bool _stopping{false};
+
+    // ThreadAffinity mode state
+    std::unique_ptr<AffinitySlot[]> _slots;
+    size_t _slotCount{0};
+    std::unique_ptr<detail::MpmcQueue<Database*>> _freeList;
+    std::atomic<size_t> _cachedCount{0};  // Connections in slots + free list
+    std::atomic<size_t> _waiterCount{0};  // Mirrors _waiters.size()
+    std::atomic<uint64_t> _fastAcquisitions{0};
+};
+
+// What a ClusterPool lease will be used for
+enum class Access {
+    ReadWrite,  // Always the primary
+    ReadOnly,   // A healthy replica when one is available
+};
+
+struct ClusterOptions {
+    // Settings for the primary's and every replica's pool
+    PoolOptions pool;
+
+    // Consecutive failed acquisitions that eject a replica, and how long it
+    // stays out before it is tried again
+    size_t maxFailures{3};
+    std::chrono::milliseconds ejectionTime{30000};
+
+    // Skip replicas replaying more than this behind the primary (0 = no
+    // check), measured at most once per lagCheckInterval per replica
+    std::chrono::milliseconds maxReplicationLag{0};
+    std::chrono::milliseconds lagCheckInterval{5000};
+
+    // Serve ReadOnly leases from the primary when no replica can; if false,
+    // wait on the least busy healthy replica instead
+    bool fallbackToPrimary{true};
+};
+
+struct ReplicaStats {
+    PoolStats pool;
+    bool ejected{false};
+    bool lagging{false};
+    std::optional<std::chrono::milliseconds> lag;  // Last measured
+};
+
+struct ClusterStats {
+    PoolStats primary;
+    std::vector<ReplicaStats> replicas;
+};
+
+// Connection pools for a primary and its read replicas. ReadOnly leases go
+// to the healthy replica with the fewest connections in use or waited for.
+class ClusterPool {
+   public:
+    ClusterPool(const std::string& primary,
+                const std::vector<std::string>& replicas,
+                const ClusterOptions& options = {});
+
+    // Lease a connection for access, waiting up to timeout. Throws
+    // PoolTimeoutError if none became available.
+    PooledConnection lease(Access access, std::chrono::milliseconds timeout);
+
+    // Non-blocking: an empty lease if nothing is available
+    PooledConnection get_connection(Access access);
+
+    ClusterStats stats() const;
+
+    // register_prepared() on every endpoint's pool
+    void register_prepared(const std::string& name, const std::string& sql);
+
+   private:
+    struct Replica {
+        std::unique_ptr<ConnectionPool> pool;
+        size_t failures{0};
+        std::chrono::steady_clock::time_point ejectedUntil;
+        std::chrono::steady_clock::time_point lastLagCheck;
+        std::optional<std::chrono::milliseconds> lag;
+        bool lagging{false};
+    };
+
+    // Eligible replicas, least busy first
+    std::vector<size_t> replica_candidates() const;
+
+    // A connection from the best replica that has one to spare
+    PooledConnection lease_replica();
+
+    // Measure lag on conn if it is due; false if the replica is too far
+    // behind or the check failed
+    bool check_lag(size_t index, Database& conn);
+
+    void record_failure(size_t index);
+    void record_success(size_t index);
+
+    ClusterOptions _options;
+    std::unique_ptr<ConnectionPool> _primary;
+    std::vector<Replica> _replicas;
+    mutable std::mutex _mutex;  // Guards replica health state
+};
+
+// A NOTIFY received by a Subscriber
+struct Notification {
+    std::string channel;
+    std::string payload;
+    int backendPid{0};  // Server process that sent it
+};
+
+struct SubscriberOptions {
+    // After the first notification of a burst, keep collecting for this
+    // long and dispatch them together
+    std::chrono::milliseconds batchWindow{10};
+
+    // Longest wait for a notification before picking up new channels
+    std::chrono::milliseconds pollInterval{100};
+
+    // Reconnect delay after a lost connection, doubled up to the maximum
+    std::chrono::milliseconds reconnectBackoff{100};
+    std::chrono::milliseconds maxReconnectBackoff{10000};
+};
+
+// LISTENs on channels over one dedicated connection, outside any pool, and
+// calls back with notifications from a background thread. After a lost
+// connection it reconnects with backoff, LISTENs again on every channel
+// and calls each callback once with an empty batch, since notifications
+// sent in between were missed.
+class Subscriber {
+   public:
+    // Notifications on one channel, in arrival order; empty after a
+    // reconnect. Runs on the event thread: keep it short.
+    using Callback = std::function<void(const std::vector<Notification>&)>;
+
+    explicit Subscriber(const std::string& connectionString,
+                        const SubscriberOptions& options = {});
+
+    Subscriber(const Subscriber&) = delete;
+    Subscriber& operator=(const Subscriber&) = delete;
+
+    // Stops the event thread and closes the connection
+    ~Subscriber();
+
+    // Call callback for notifications on channel; LISTEN is issued on the
+    // event thread within pollInterval
+    void listen(const std::string& channel, Callback callback);
+
+    // Whether the connection is currently up
+    bool connected() const;
+
+   private:
+    class Receiver;
+
+    // Event thread
+    void run();
+    void open();
+    void close();
+    void listen_new_channels();
+    void wait_for_batch();
+    void dispatch(std::vector<Notification>& batch);
+    void dispatch_reconnected();
+
+    std::string _connectionString;
+    SubscriberOptions _options;
+
+    mutable std::mutex _mutex;  // Guards _callbacks and _stopping
+    std::unordered_map<std::string, std::vector<Callback>> _callbacks;
+    bool _stopping{false};
+    std::condition_variable _workerCv;
+
+    // Owned by the event thread
+    std::unique_ptr<pqxx::connection> _conn;
+    std::vector<std::unique_ptr<Receiver>> _receivers;
+    std::unordered_set<std::string> _listening;
+    std::vector<Notification> _received;  // Filled by Receivers
+
+    std::atomic<bool> _connected{false};
+    std::thread _worker;
+};
+
+// Non-blocking query execution on one connection, for event loops. Queries
+// are sent as soon as they are queued; the caller watches socket() for
+// readability and calls poll(), which completes the futures of queries
+// whose results have arrived. One thread can drive many of these, e.g. one
+// per connection leased from a ConnectionPool. Not thread-safe.
+class AsyncConnection {
+   public:
+    explicit AsyncConnection(const std::string& connectionString);
+
+    // Multiplex a pooled connection; it goes back to the pool with this.
+    // Throws std::invalid_argument if lease is empty.
+    explicit AsyncConnection(PooledConnection lease);
+
+    AsyncConnection(const AsyncConnection&) = delete;
+    AsyncConnection& operator=(const AsyncConnection&) = delete;
+
+    // Waits for queries still in flight
+    ~AsyncConnection();
+
+    // Queue a query; queries run in order. One sent while earlier ones are
+    // still in flight waits and goes out with the others queued meanwhile,
+    // as one batch that the server runs as a single transaction: a failure
+    // rolls back and fails the rest of its batch (see Pipeline).
+    std::future<Result> async_exec(const std::string& sql);
+
+    template <typename... Args>
+    std::future<Result> async_exec_params(const std::string& sql,
+                                          Args&&... args);
+
+    // Descriptor to watch for readability
+    int socket() const;
+
+    // Complete every query whose result has arrived, without blocking;
+    // returns how many completed
+    size_t poll();
+
+    // Block until every queued query has completed
+    void wait();
+
+    // Queries queued and not yet completed
+    size_t pending() const;
+
+   private:
+    struct Pending {
+        QueryHandle handle;
+        std::promise<Result> promise;
+    };
+
+    std::future<Result> enqueue(QueryHandle handle);
+
+    // Fulfil the oldest pending query's future
+    void complete_front();
+
+    std::unique_ptr<Database> _ownedDb;
+    PooledConnection _lease;
+    Database* _db;
+    Pipeline _pipeline;
+    std::deque<Pending> _pending;  // In submission order
+};
+
+// Member template definitions. They live here rather than in
+// pg_wrapper.cpp so callers can instantiate them for their own types and
+// the compiler can inline field decoding and parameter binding.
+
+namespace detail {
+
+// Get value by column index
+template <typename Derived>
+template <typename T>
+T RowAccessors<Derived>::get(int col) const {
+    if (col >= self().field_count()) {
+        throw std::out_of_range("Column index out of range");
+    }
+    return decode_field<T>(self().field(col));
+}
+
+// Get value by column name
+template <typename Derived>
+template <typename T>
+T RowAccessors<Derived>::get(const std::string& colName) const {
+    return decode_field<T>(self().field(self().column_index(colName)));
+}
+
+// Get optional value (returns nullopt if NULL)
+template <typename Derived>
+template <typename T>
+std::optional<T> RowAccessors<Derived>::get_optional(int col) const {
+    if (col >= self().field_count()) {
+        throw std::out_of_range("Column index out of range");
+    }
+    return decode_field<std::optional<T>>(self().field(col));
+}
+
+template <typename Derived>
+template <typename T>
+std::optional<T> RowAccessors<Derived>::get_optional(
+    const std::string& colName) const {
+    return decode_field<std::optional<T>>(
+        self().field(self().column_index(colName)));
+}
+
+// Access by a column resolved with Result::column()
+template <typename Derived>
+template <typename T>
+T RowAccessors<Derived>::get(ColumnRef col) const {
+    return get<T>(col.index);
+}
+
+template <typename Derived>
+template <typename T>
+std::optional<T> RowAccessors<Derived>::get_optional(ColumnRef col) const {
+    return get_optional<T>(col.index);
+}
+
+// Fields are read straight from the result by (row, column), so a whole
+// result converts without constructing a pqxx::row per row
+template <typename Tuple, size_t... I>
+Tuple row_to_tuple(const pqxx::result& result, int row,
+                   std::index_sequence<I...>) {
+    return Tuple(decode_field<std::tuple_element_t<I, Tuple>>(
+        result.at(row, int(I)))...);
+}
+
+template <typename T, typename M>
+void assign_field(T& value, M T::*member, const pqxx::field& field) {
+    value.*member = decode_field<M>(field);
+}
+
+template <typename T, typename Bindings, size_t... I>
+T row_to_struct(const pqxx::result& result, int row, const Bindings& bindings,
+                const std::array<int, sizeof...(I)>& indexes,
+                std::index_sequence<I...>) {
+    T value{};
+    (assign_field(value, std::get<I>(bindings).member,
+                  result.at(row, indexes[I])),
+     ...);
+    return value;
+}
+
+// INSERT of rows rows, with the ON CONFLICT clause options asks for
+std::string build_insert_sql(const std::string& table,
+                             const std::vector<std::string>& columns,
+                             size_t rows, const BatchInsertOptions& options);
+
+// Rows per statement, given PostgreSQL's limit of 65535 bind parameters
+size_t batch_rows(size_t columns, const BatchInsertOptions& options);
+
+}  // namespace detail
+
+// Convert all rows to vector
+template <typename T, typename Converter>
+std::vector<T> Result::to_vector(Converter&& converter) const {
+    std::vector<T> vec;
+    vec.reserve(size());
+    for (const auto& row : *this) {
+        vec.push_back(converter(row));
+    }
+    return vec;
+}
+
+// Convert all rows to a tuple by position, or to a RowMapping<T> struct
+template <typename T>
+std::vector<T> Result::as() const {
+    std::vector<T> vec;
+    vec.reserve(size());
+
+    if constexpr (detail::is_tuple<T>::value) {
+        constexpr size_t N = std::tuple_size_v<T>;
+        if (N > columns()) {
+            throw std::out_of_range("Column index out of range");
+        }
+        const int rows = _result.size();
+        for (int row = 0; row < rows; ++row) {
+            vec.push_back(detail::row_to_tuple<T>(
+                _result, row, std::make_index_sequence<N>()));
+        }
+    } else {
+        const auto& bindings = RowMapping<T>::columns;
+        constexpr size_t N =
+            std::tuple_size_v<std::decay_t<decltype(RowMapping<T>::columns)>>;
+
+        // Resolve every column name once for the whole result
+        std::array<int, N> indexes{};
+        std::apply(
+            [&](const auto&... binding) {
+                size_t i = 0;
+                ((indexes[i++] = column_index().find(binding.name)), ...);
+            },
+            bindings);
+
+        const int rows = _result.size();
+        for (int row = 0; row < rows; ++row) {
+            vec.push_back(detail::row_to_struct<T>(
+                _result, row, bindings, indexes,
+                std::make_index_sequence<N>()));
+        }
+    }
+    return vec;
+}
+
+namespace detail {
+
+// Length-prefixed text of a parameter, or "-" for NULL
+template <typename T>
+void append_cache_key(std::string& key, const T& value) {
+    if constexpr (is_optional<T>::value) {
+        if (!value) {
+            key += "\x1f-";
+            return;
+        }
+        append_cache_key(key, *value);
+    } else if constexpr (std::is_same_v<T, std::nullptr_t>) {
+        key += "\x1f-";
+    } else {
+        const std::string text = pqxx::to_string(value);
+        key += '\x1f';
+        key += std::to_string(text.size());
+        key += ':';
+        key += text;
+    }
+}
+
+}  // namespace detail
+
+// Cache key: the SQL followed by each argument's text
+template <typename... Args>
+std::string QueryCache::key(const std::string& sql, const Args&... args) {
+    std::string key = sql;
+    (detail::append_cache_key(key, args), ...);
+    return key;
+}
+
+// Execute parameterized query
+template <typename... Args>
+Result Transaction::exec_params(const std::string& sql, Args&&... args) {
+    const detail::QueryTimer timer(observer(), sql);
+    try {
+        pqxx::result raw;
+        if constexpr (binds_to_arena<Args...>) {
+            raw = _txn->exec_params(sql, param_arena().bind(args...));
+        } else {
+            raw = _txn->exec_params(sql, std::forward<Args>(args)...);
+        }
+        Result result(std::move(raw));
+        timer.succeeded(result);
+        return result;
+    } catch (const pqxx::sql_error& e) {
+        timer.failed(e);
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        timer.failed(e);
+        detail::throw_database_error(e);
+    }
+}
+
+// Execute prepared statement
+template <typename... Args>
+Result Transaction::exec_prepared(const std::string& name, Args&&... args) {
+    if (_owner) {
+        _owner->ensure_prepared(name);
+    }
+    return run_prepared(name, name, std::forward<Args>(args)...);
+}
+
+// Execute a Statement, preparing it on first use
+template <typename RowT, typename... Params, typename... Args>
+Result Transaction::exec_prepared(const Statement<RowT(Params...)>& stmt,
+                                  Args&&... args) {
+    static_assert(sizeof...(Args) == sizeof...(Params),
+                  "wrong number of arguments for Statement");
+    if (!_owner) {
+        // Nowhere to remember what this connection has prepared
+        return exec_params(
+            stmt.sql(), detail::bind_as<Params>(std::forward<Args>(args))...);
+    }
+    _owner->ensure_prepared(stmt.hash(), stmt.name(), stmt.sql());
+    return run_prepared(stmt.name(), stmt.sql(),
+                        detail::bind_as<Params>(std::forward<Args>(args))...);
+}
+
+// Execute a Statement and decode its rows as RowT
+template <typename RowT, typename... Params, typename... Args>
+std::vector<RowT> Transaction::query(const Statement<RowT(Params...)>& stmt,
+                                     Args&&... args) {
+    static_assert(!std::is_void_v<RowT>, "Statement returns no rows");
+    return exec_prepared(stmt, std::forward<Args>(args)...).template as<RowT>();
+}
+
+// Run an already prepared statement
+template <typename... Args>
+Result Transaction::run_prepared(pqxx::zview name, std::string_view label,
+                                 Args&&... args) {
+    const detail::QueryTimer timer(observer(), label);
+    try {
+        pqxx::result raw;
+        if constexpr (binds_to_arena<Args...>) {
+            raw = _txn->exec_prepared(name, param_arena().bind(args...));
+        } else {
+            raw = _txn->exec_prepared(name, std::forward<Args>(args)...);
+        }
+        Result result(std::move(raw));
+        timer.succeeded(result);
+        return result;
+    } catch (const pqxx::sql_error& e) {
+        timer.failed(e);
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        timer.failed(e);
+        detail::throw_database_error(e);
+    }
+}
+
+// Stream a query's rows as typed tuples within this transaction
+template <typename... Types>
+StreamingResult<Types...> Transaction::stream(const std::string& sql) {
+    return StreamingResult<Types...>(nullptr, this, sql);
+}
+
+// Queue a parameterized query
+template <typename... Args>
+QueryHandle Pipeline::exec_params(const std::string& sql, Args&&... args) {
+    const std::vector<std::string> literals{
+        _txn->_txn->quote(std::forward<Args>(args))...};
+    return insert(bind(sql, literals));
+}
+
+// Queue a prepared statement
+template <typename... Args>
+QueryHandle Pipeline::exec_prepared(const std::string& name, Args&&... args) {
+    const std::string quotedName = _txn->_txn->quote_name(name);
+    if (_txn->_owner) {
+        // Prepare a registered statement in the same batch
+        if (auto sql = _txn->_owner->take_unprepared(name)) {
+            const QueryHandle prepare =
+                insert("PREPARE " + quotedName + " AS " + *sql);
+            _prepares.emplace(prepare.id, PendingPrepare{_txn->_owner, name});
+        }
+    }
+
+    const std::vector<std::string> literals{
+        _txn->_txn->quote(std::forward<Args>(args))...};
+    std::string sql = "EXECUTE " + quotedName;
+    for (size_t i = 0; i < literals.size(); ++i) {
+        sql += (i == 0 ? "(" : ", ") + literals[i];
+    }
+    if (!literals.empty()) {
+        sql += ")";
+    }
+    return insert(sql);
+}
+
+// Write one row given as separate values
+template <typename... Values>
+void Inserter::write_values(const Values&... values) {
+    open_chunk();
+    try {
+        _stream->write_values(values...);
+    } catch (const pqxx::sql_error& e) {
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+    row_written();
+}
+
+// Write one row given as a tuple or container of values
+template <typename Row>
+void Inserter::write_row(const Row& row) {
+    open_chunk();
+    try {
+        _stream->write_row(row);
+    } catch (const pqxx::sql_error& e) {
+        detail::throw_query_error(e);
+    } catch (const std::exception& e) {
+        detail::throw_database_error(e);
+    }
+    row_written();
+}
+
+// Execute parameterized query without transaction
+template <typename... Args>
+Result Database::exec_params(const std::string& sql, Args&&... args) {
+    if (_stmtCache) {
+        return exec_prepared(cached_statement(sql),
+                             std::forward<Args>(args)...);
+    }
+    auto txn = begin_statement();
+    auto result = txn.exec_params(sql, std::forward<Args>(args)...);
+    txn.commit();
+    return result;
+}
+
+// Execute prepared statement without transaction
+template <typename... Args>
+Result Database::exec_prepared(const std::string& name, Args&&... args) {
+    auto txn = begin_statement();
+    auto result = txn.exec_prepared(name, std::forward<Args>(args)...);
+    txn.commit();
+    return result;
+}
+
+// Execute a Statement without transaction
+template <typename RowT, typename... Params, typename... Args>
+Result Database::exec_prepared(const Statement<RowT(Params...)>& stmt,
+                               Args&&... args) {
+    auto txn = begin_statement();
+    auto result = txn.exec_prepared(stmt, std::forward<Args>(args)...);
+    txn.commit();
+    return result;
+}
+
+// Execute a Statement and decode its rows as RowT
+template <typename RowT, typename... Params, typename... Args>
+std::vector<RowT> Database::query(const Statement<RowT(Params...)>& stmt,
+                                  Args&&... args) {
+    static_assert(!std::is_void_v<RowT>, "Statement returns no rows");
+    return exec_prepared(stmt, std::forward<Args>(args)...).template as<RowT>();
+}
+
+// exec_params() through the query cache
+template <typename... Args>
+Result Database::exec_cached(std::initializer_list<std::string_view> tables,
+                             const std::string& sql, Args&&... args) {
+    if (!_queryCache) {
+        return exec_params(sql, std::forward<Args>(args)...);
+    }
+
+    const std::string key = QueryCache::key(sql, args...);
+    std::optional<Result> cached = _queryCache->find(key);
+    if (_observer) {
+        _observer->on_cache(
+            CacheEvent{sql, fingerprint_sql(sql), cached.has_value()});
+    }
+    if (cached) {
+        return std::move(*cached);
+    }
+
+    const uint64_t generation = _queryCache->generation();
+    Result result = exec_params(sql, std::forward<Args>(args)...);
+    _queryCache->insert(key, result, tables, generation);
+    return result;
+}
+
+// Simple insert helper
+template <typename... Args>
+void Database::insert(const std::string& table,
+                      const std::vector<std::string>& columns,
+                      Args&&... values) {
+    if (sizeof...(values) != columns.size()) {
+        throw std::invalid_argument(
+            "Number of values doesn't match number of columns");
+    }
+
+    exec_prepared(insert_statement(table, columns, 1, {}),
+                  std::forward<Args>(values)...);
+}
+
+// Stream a query's rows as typed tuples without materializing them
+template <typename... Types>
+StreamingResult<Types...> Database::stream(const std::string& sql) {
+    return StreamingResult<Types...>(new_nontransaction(), nullptr, sql);
+}
+
+// COPY a range of tuples into table; returns rows written
+template <typename Rows>
+size_t Database::bulk_insert(const std::string& table,
+                             const std::vector<std::string>& columns,
+                             const Rows& rows,
+                             const BulkInsertOptions& options) {
+    auto ins = inserter(table, columns, options);
+    for (const auto& row : rows) {
+        ins.write_row(row);
+    }
+    return ins.finish();
+}
+
+// Multi-row INSERT or upsert of a range of tuples in one transaction
+template <typename Rows>
+size_t Database::batch_insert(const std::string& table,
+                              const std::vector<std::string>& columns,
+                              const Rows& rows,
+                              const BatchInsertOptions& options) {
+    using Tuple = std::decay_t<decltype(*std::begin(rows))>;
+    static_assert(detail::is_tuple<Tuple>::value,
+                  "batch_insert() takes a range of std::tuple rows");
+    if (columns.empty() || std::tuple_size_v<Tuple> != columns.size()) {
+        throw std::invalid_argument(
+            "Number of values doesn't match number of columns");
+    }
+
+    const size_t batchRows = detail::batch_rows(columns.size(), options);
+    // Prepare before BEGIN so a failure leaves no transaction behind
+    const std::string& fullBatch =
+        insert_statement(table, columns, batchRows, options);
+
+    auto txn = new_transaction();
+    size_t affected = 0;
+    size_t pending = 0;
+    pqxx::params params;
+    params.reserve(batchRows * columns.size());
+
+    for (const auto& row : rows) {
+        std::apply([&](const auto&... value) { (params.append(value), ...); },
+                   row);
+        if (++pending == batchRows) {
+            affected += txn->exec_prepared(fullBatch, params).affected_rows();
+            params = pqxx::params();
+            params.reserve(batchRows * columns.size());
+            pending = 0;
+        }
+    }
+
+    // The short last batch runs once, so it isn't worth preparing
+    if (pending > 0) {
+        affected += txn->exec_params(detail::build_insert_sql(
+                                         table, columns, pending, options),
+                                     params)
+                        .affected_rows();
+    }
+
+    txn->commit();
+    return affected;
+}
+
+// Run fn in a transaction, retrying rollbacks with jittered backoff
+template <typename Fn>
+auto Database::run_in_transaction(Fn&& fn, const RetryPolicy& policy,
+                                  const TransactionOptions& options)
+    -> std::invoke_result_t<Fn&, Transaction&> {
+    using R = std::invoke_result_t<Fn&, Transaction&>;
+    std::chrono::microseconds backoff = policy.initialBackoff;
+    for (size_t attempt = 1;; ++attempt) {
+        try {
+            Transaction txn = begin_transaction(options);
+            if constexpr (std::is_void_v<R>) {
+                fn(txn);
+                if (!txn._committed) {
+                    txn.commit();
+                }
+                return;
+            } else {
+                R result = fn(txn);
+                if (!txn._committed) {
+                    txn.commit();
+                }
+                return result;
+            }
+        } catch (const TransactionRollbackError&) {
+            if (attempt >= policy.maxAttempts) {
+                throw;
+            }
+        }
+        // The failed transaction is rolled back by now, so the sleep
+        // doesn't hold its locks
+        std::this_thread::sleep_for(detail::jittered(backoff));
+        backoff = std::min<std::chrono::microseconds>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                backoff * policy.backoffMultiplier),
+            policy.maxBackoff);
+    }
+}
+
+// Queue a parameterized query
+template <typename... Args>
+std::future<Result> AsyncConnection::async_exec_params(const std::string& sql,
+                                                       Args&&... args) {
+    return enqueue(_pipeline.exec_params(sql, std::forward<Args>(args)...));
+}
+
+}  // namespace pg_wrapper